@@ -0,0 +1,219 @@
+#include "HodgkinHuxley.hpp"
+#include "Experiment.hpp"
+#include "Protocol.hpp"
+#include "RateFunctions.hpp"
+#include "RateTable.hpp"
+#include "Trace.hpp"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace Jarl;
+
+/*
+ * Benchmark [results] [duration] times the pieces rateExperiment spends its
+ * time in. Every result is a run\tbenchmark\tvalue\tunit line, where run
+ * is the start time of the run, on stdout and, if given, appended to
+ * results so runs of different builds can be compared.
+ * duration is the simulated length of the reference run in ms, 200500 for
+ * the full one.
+ */
+
+static const int repeats = 5;
+
+static double seconds() {
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Keeps results the compiler could otherwise prove unused.
+static volatile Scalar sink;
+
+// Best of several timings of body(count), in ns per iteration.
+template<typename Body>
+static double measure(const Body& body, const long count) {
+  double best = 0;
+  for(int repeat = 0;repeat < repeats;repeat++) {
+    double start = seconds();
+    body(count);
+    double elapsed = seconds() - start;
+    if(repeat == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best * 1e9 / count;
+}
+
+static ofstream results;
+static string run;
+
+static void report(const string& name, const double value, const string& unit) {
+  stringstream line;
+  line.precision(6);
+  line << run << "\t" << name << "\t" << value << "\t" << unit << "\n";
+  cout << line.str() << flush;
+  if(results.is_open()) {
+    results << line.str() << flush;
+  }
+}
+
+// Sweeps the rate function over the physiological range so every branch is exercised.
+template<typename Rate>
+static void benchmarkRate(const string& name, const Rate& rate) {
+  const long count = 1 << 20;
+  report("rate/" + name, measure([&rate](const long count) {
+	Scalar sum = 0;
+	for(long i = 0;i < count;i++) {
+	  sum += rate(-100 + (i & 1023) * (150. / 1024));
+	}
+	sink = sum;
+      }, count), "ns/call");
+}
+
+static void benchmarkSimulate(const HodgkinHuxley::Settings& settings) {
+  const long count = 1 << 16;
+  report("simulate", measure([&settings](const long count) {
+	HodgkinHuxley neuron(settings);
+	neuron.setBlebbing(1);
+	neuron.setLeftShift(2);
+	for(long i = 0;i < count;i++) {
+	  neuron.simulate(1e-3, 0, true);
+	}
+	sink = neuron.getPotential();
+      }, count), "ns/call");
+}
+
+static void benchmarkAdvance(const HodgkinHuxley::Settings& settings, const HodgkinHuxley::Integrator integrator,
+			     const string& name) {
+  const long count = 1 << 14;
+  report("advance/" + name, measure([&settings, integrator](const long count) {
+	HodgkinHuxley neuron(settings);
+	neuron.setIntegrator(integrator);
+	neuron.setBlebbing(1);
+	neuron.setLeftShift(2);
+	for(long i = 0;i < count;i++) {
+	  neuron.advance(.1);
+	}
+	sink = neuron.getPotential();
+      }, count), "ns/step");
+}
+
+// Simulated ms per wall clock second of the reference rateExperiment(1, 2, 0), without a trace.
+static void benchmarkExperiment(const HodgkinHuxley::Settings& settings, const HodgkinHuxley::Integrator integrator,
+				const string& name, const Scalar duration, const string& directory) {
+  ExperimentSettings experiment;
+  experiment.neuron = settings;
+  experiment.integrator = integrator;
+  experiment.traceFormat = ExperimentSettings::NoTrace;
+  experiment.verbose = false;
+  experiment.directory = directory;
+  Protocol protocol = Protocol::standard(1, 2, 0);
+  protocol.setDuration(duration);
+  double start = seconds();
+  protocolExperiment(experiment, protocol, "benchmark_" + name);
+  report("experiment/" + name, duration / (seconds() - start), "ms/s");
+}
+
+static void benchmarkWriters(const string& directory) {
+  const long rows = 1 << 20;
+  const double bytes = rows * 4.0 * sizeof(Scalar);
+  string path = directory + "/benchmark.trace";
+  vector<string> names(4, "column"), units(4, "");
+
+  double start = seconds();
+  {
+    TraceWriter trace(path, names, units, "");
+    Scalar row[4] = {0, -60, -80, 50};
+    for(long i = 0;i < rows;i++) {
+      row[0] = i * 1e-4;
+      trace.append(row);
+    }
+    trace.close();
+  }
+  double elapsed = seconds() - start;
+  report("writer/binary", rows / elapsed, "rows/s");
+  report("writer/binary_bandwidth", bytes / elapsed / 1e6, "MB/s");
+  remove(path.c_str());
+
+  path = directory + "/benchmark_compressed.trace";
+  start = seconds();
+  {
+    TraceWriter trace(path, names, units, "", 8192, true);
+    Scalar row[4] = {0, -60, -80, 50};
+    for(long i = 0;i < rows;i++) {
+      row[0] = i * 1e-4;
+      row[1] = -60 + 30 * sin(i * 1e-3);
+      trace.append(row);
+    }
+    trace.close();
+  }
+  elapsed = seconds() - start;
+  struct stat status;
+  stat(path.c_str(), &status);
+  report("writer/compressed", rows / elapsed, "rows/s");
+  report("writer/compressed_ratio", bytes / status.st_size, "x");
+  remove(path.c_str());
+
+  path = directory + "/benchmark.tsv";
+  start = seconds();
+  {
+    ofstream output(path.c_str());
+    for(long i = 0;i < rows;i++) {
+      output << i * 1e-4 << "\t" << -60 << "\t" << -80 << "\t" << 50 << "\n";
+    }
+  }
+  report("writer/tab_separated", rows / (seconds() - start), "rows/s");
+  remove(path.c_str());
+}
+
+int main(int argc, char* argv[]) {
+  string directory = "benchmarks";
+  mkdir(directory.c_str(), 0777);
+  char stamp[32];
+  time_t now = time(NULL);
+  strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+  run = stamp;
+  if(argc > 1) {
+    results.open(argv[1], ios::app);
+    if(!results) {
+      cerr << argv[1] << ": cannot open" << endl;
+      return 1;
+    }
+  }
+  Scalar duration = argc > 2 ? atof(argv[2]) : 10000;
+
+  HodgkinHuxley::Settings settings = referenceSettings();
+  RateTable table(1e-10);
+
+  benchmarkRate("alphaN", [](const Scalar v) { return alphaN(v); });
+  benchmarkRate("betaN", [](const Scalar v) { return betaN(v); });
+  benchmarkRate("alphaM", [](const Scalar v) { return alphaM(v); });
+  benchmarkRate("betaM", [](const Scalar v) { return betaM(v); });
+  benchmarkRate("alphaH", [](const Scalar v) { return alphaH(v); });
+  benchmarkRate("betaH", [](const Scalar v) { return betaH(v); });
+  benchmarkRate("table_alphaN", [&table](const Scalar v) { return table.alphaN(v); });
+  benchmarkRate("table_alphaM", [&table](const Scalar v) { return table.alphaM(v); });
+  benchmarkRate("table_alphaH", [&table](const Scalar v) { return table.alphaH(v); });
+
+  benchmarkSimulate(settings);
+  benchmarkAdvance(settings, HodgkinHuxley::DormandPrince, "dormand_prince");
+  benchmarkAdvance(settings, HodgkinHuxley::RushLarsen, "rush_larsen");
+  benchmarkAdvance(settings, HodgkinHuxley::Multirate, "multirate");
+
+  benchmarkExperiment(settings, HodgkinHuxley::RungeKutta, "runge_kutta", duration, directory);
+  benchmarkExperiment(settings, HodgkinHuxley::DormandPrince, "dormand_prince", duration, directory);
+  benchmarkExperiment(settings, HodgkinHuxley::RushLarsen, "rush_larsen", duration, directory);
+  benchmarkExperiment(settings, HodgkinHuxley::Multirate, "multirate", duration, directory);
+
+  benchmarkWriters(directory);
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include "Cable.hpp"
+
+using namespace std;
+
+namespace Jarl {
+  class Cable::Private {
+  public:
+    vector<HodgkinHuxley> compartments;
+    Scalar capacitance;
+    Scalar coupling;
+    vector<Scalar> lower, diagonal, upper, right, potentials;
+
+    Private(const HodgkinHuxley::Settings& settings, const int size, const Scalar radius, const Scalar length,
+	    const Scalar axialResistivity) :
+      compartments(size, HodgkinHuxley(settings)), capacitance(settings.capacitance),
+      lower(size), diagonal(size), upper(size), right(size), potentials(size) {
+      // a / (2 R L²) in S/cm² with a and L in cm.
+      Scalar radiusCm = radius * 1e-4;
+      Scalar lengthCm = length * 1e-4;
+      coupling = 1e3 * radiusCm / (2 * axialResistivity * lengthCm * lengthCm);
+    }
+
+    /*
+     * Backward Euler in the potentials with each membrane linearised about
+     * the start of the step:
+     * C (V'_i - V_i) / dt = -G_i (V'_i - E_i) + g (V'_{i-1} - 2 V'_i + V'_{i+1}).
+     */
+    void simulate(const Scalar step) {
+      const int size = compartments.size();
+      const Scalar storage = capacitance / step;
+      for(int i = 0;i < size;i++) {
+	Scalar conductance, steadyPotential;
+	compartments[i].getMembrane(conductance, steadyPotential);
+	int neighbours = (i > 0) + (i < size - 1);
+	lower[i] = i > 0 ? -coupling : 0;
+	upper[i] = i < size - 1 ? -coupling : 0;
+	diagonal[i] = storage + conductance + neighbours * coupling;
+	right[i] = storage * compartments[i].getPotential() + conductance * steadyPotential;
+      }
+      solve();
+      for(int i = 0;i < size;i++) {
+	compartments[i].advanceChannels(potentials[i], step);
+      }
+    }
+
+    // Thomas algorithm, the unbranched case of Hines' elimination. diagonal and right are overwritten.
+    void solve() {
+      const int size = compartments.size();
+      for(int i = 1;i < size;i++) {
+	Scalar factor = lower[i] / diagonal[i - 1];
+	diagonal[i] -= factor * upper[i - 1];
+	right[i] -= factor * right[i - 1];
+      }
+      potentials[size - 1] = right[size - 1] / diagonal[size - 1];
+      for(int i = size - 2;i >= 0;i--) {
+	potentials[i] = (right[i] - upper[i] * potentials[i + 1]) / diagonal[i];
+      }
+    }
+  };
+
+  Cable::Cable(const HodgkinHuxley::Settings& settings, const int size, const Scalar radius, const Scalar length,
+	       const Scalar axialResistivity) :
+    priv(new Private(settings, size, radius, length, axialResistivity)) {}
+
+  Cable::~Cable() {
+    delete priv;
+  }
+
+  int Cable::size() const {
+    return priv->compartments.size();
+  }
+
+  void Cable::simulate(const Scalar step) {
+    priv->simulate(step);
+  }
+
+  Scalar Cable::getCouplingConductance() const {
+    return priv->coupling;
+  }
+
+  void Cable::setStimulation(const int compartment, const Scalar stimulation) {
+    priv->compartments[compartment].setStimulation(stimulation);
+  }
+
+  void Cable::setBlebbing(const int compartment, const Scalar blebbing) {
+    priv->compartments[compartment].setBlebbing(blebbing);
+  }
+
+  void Cable::setLeftShift(const int compartment, const Scalar leftShift) {
+    priv->compartments[compartment].setLeftShift(leftShift);
+  }
+
+  bool Cable::isSpiked(const int compartment) const {
+    return priv->compartments[compartment].isSpiked();
+  }
+
+  Scalar Cable::getPotential(const int compartment) const {
+    return priv->compartments[compartment].getPotential();
+  }
+
+  const HodgkinHuxley& Cable::getCompartment(const int compartment) const {
+    return priv->compartments[compartment];
+  }
+}
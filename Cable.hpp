@@ -0,0 +1,41 @@
+#ifndef CABLE_HPP
+#define CABLE_HPP
+
+#include "HodgkinHuxley.hpp"
+#include <vector>
+
+namespace Jarl {
+  /*
+   * An unbranched axon of identical cylindrical compartments, each a
+   * HodgkinHuxley membrane, coupled by the axial resistance between
+   * neighbours. The ends are sealed. Every step solves the potentials
+   * implicitly as one tridiagonal system, which is stable at any step
+   * size, and then advances each compartment's channels with its new
+   * potential held.
+   * radius and length are in µm, axialResistivity in Ω cm. size must be
+   * at least 1.
+   */
+  class Cable {
+  public:
+    Cable(const HodgkinHuxley::Settings& settings, const int size, const Scalar radius, const Scalar length,
+	  const Scalar axialResistivity);
+    ~Cable();
+    int size() const;
+    void simulate(const Scalar step);
+    // Between neighbouring compartments, per unit of membrane, in mS/cm².
+    Scalar getCouplingConductance() const;
+    void setStimulation(const int compartment, const Scalar stimulation);
+    void setBlebbing(const int compartment, const Scalar blebbing);
+    void setLeftShift(const int compartment, const Scalar leftShift);
+    bool isSpiked(const int compartment) const;
+    Scalar getPotential(const int compartment) const;
+    const HodgkinHuxley& getCompartment(const int compartment) const;
+  private:
+    Cable(const Cable&);
+    Cable& operator=(const Cable&);
+    class Private;
+    Private* const priv;
+  };
+}
+
+#endif
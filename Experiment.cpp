@@ -0,0 +1,562 @@
+#include "Experiment.hpp"
+#include "Cable.hpp"
+#include "HodgkinHuxleyBatch.hpp"
+#include "Network.hpp"
+#include "Instrumentation.hpp"
+#include "SpikeAnalyzer.hpp"
+#include "Serialization.hpp"
+#include "SteadyStateDetector.hpp"
+#include "Progress.hpp"
+#include "Protocol.hpp"
+#include "RateRun.hpp"
+#include "Refinement.hpp"
+#include "Sweep.hpp"
+#include "Trace.hpp"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <sstream>
+#include <time.h>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace Jarl {
+  ExperimentSettings::ExperimentSettings() {
+    integrator = HodgkinHuxley::RungeKutta;
+    rateTable = NULL;
+    resolution = 1e-3;
+    maximumStep = 100*resolution;
+    writeResolution = (int)(.1/resolution);
+    traceFormat = TabSeparated;
+    traceTolerance = 0;
+    rateWindow = 5000;
+    checkpointInterval = 0;
+    earlyStop = false;
+    noise = HodgkinHuxley::Deterministic;
+    seed = 0;
+    progress = NULL;
+    directory = "experiments";
+    verbose = true;
+  }
+
+  // The neuron every experiment in Main starts from.
+  HodgkinHuxley::Settings referenceSettings() {
+    HodgkinHuxley::Settings settings;
+    settings.potential = -59.9;
+    settings.threshold = -15;
+    settings.capacitance = 1;
+    settings.leakConductance = .5;
+    settings.leakReversalPotential = -59.9;
+    settings.potassiumConductance = 36;
+    settings.potassiumReversalPotential = -81.3;
+    settings.sodiumConductance = 120;
+    settings.sodiumReversalPotential = 51.5;
+    settings.maxPumpCurrent = 90.9;
+    settings.potassiumLeakConductance = .1;
+    settings.sodiumLeakConductance = .25;
+    settings.innerPotassiumConcentration = 150;
+    settings.outerPotassiumConcentration = 6;
+    settings.innerSodiumConcentration = 20;
+    settings.outerSodiumConcentration = 154;
+    settings.temperature = 293.15;
+    settings.innerVolume = 3e-15;
+    settings.outerVolume = 3e-15;
+    settings.surfaceArea = 6e-8;
+    return settings;
+  }
+
+  static mutex summaryLock;
+
+  // One line per run in <directory>/summary.tsv, shared by every run of a sweep.
+  static void appendSummary(const ExperimentSettings& settings, const string& line) {
+    lock_guard<mutex> guard(summaryLock);
+    string path = settings.directory + "/summary.tsv";
+    ofstream output(path.c_str(), ios::app);
+    if(output.tellp() == 0) {
+      output << "blebbing\tleft shift (mV)\tstimulation\t" << SpikeAnalyzer::header() << "\twall time (s)\n";
+    }
+    output << line << flush;
+  }
+
+  static const char checkpointMagic[8] = {'H', 'H', 'C', 'H', 'K', 'P', 'T', '\0'};
+  static const uint32_t checkpointVersion = 2;
+  static const Scalar blebbingStart = 100, stimulationStart = 500;
+
+  /*
+   * Checkpoint layout: magic, uint32 version, the RunState fields, the
+   * protocol boundary and uint8 ramping of the RateRun, the SpikeAnalyzer,
+   * the SteadyStateDetector and a HodgkinHuxley snapshot. With the
+   * boundary the resumed run does not set its parameters again, which
+   * would reset the detector. Written next to the final
+   * path and renamed over it, so a crash never leaves a torn checkpoint.
+   */
+  static void saveCheckpoint(const string& path, const RateRun& run) {
+    HH_TIME(writingSeconds);
+    string temporary = path + ".tmp";
+    {
+      ofstream output(temporary.c_str(), ios::binary);
+      output.write(checkpointMagic, sizeof(checkpointMagic));
+      writeBinary(output, checkpointVersion);
+      writeBinary(output, run.state.currentTime);
+      writeBinary(output, run.state.change);
+      writeBinary(output, run.state.i);
+      writeBinary(output, run.state.steps);
+      writeBinary(output, run.state.writes);
+      writeBinary(output, run.state.traceOffset);
+      writeBinary(output, run.boundary);
+      writeBinary(output, (uint8_t)run.ramping);
+      run.analyzer.save(output);
+      run.detector.save(output);
+      run.neuron.save(output);
+      if(!output) {
+	cerr << temporary << ": checkpoint write failed" << endl;
+	return;
+      }
+    }
+    rename(temporary.c_str(), path.c_str());
+  }
+
+  static bool loadCheckpoint(const string& path, RateRun& run) {
+    ifstream input(path.c_str(), ios::binary);
+    char magic[sizeof(checkpointMagic)];
+    uint32_t version;
+    if(!input.read(magic, sizeof(magic)) || memcmp(magic, checkpointMagic, sizeof(magic)) != 0
+       || !readBinary(input, version) || version != checkpointVersion) {
+      return false;
+    }
+    RunState loaded;
+    Scalar boundary;
+    uint8_t ramping;
+    if(!readBinary(input, loaded.currentTime) || !readBinary(input, loaded.change) || !readBinary(input, loaded.i)
+       || !readBinary(input, loaded.steps) || !readBinary(input, loaded.writes) || !readBinary(input, loaded.traceOffset)
+       || !readBinary(input, boundary) || !readBinary(input, ramping)
+       || !run.analyzer.restore(input) || !run.detector.restore(input) || !run.neuron.restore(input)) {
+      return false;
+    }
+    run.state = loaded;
+    run.boundary = boundary;
+    run.ramping = ramping;
+    return true;
+  }
+
+  // Hands the rows collected by a run to whichever trace file is open.
+  static void writeRows(vector<Scalar>& rows, TraceWriter* trace, ofstream& output) {
+    HH_TIME(writingSeconds);
+    for(size_t row = 0;row < rows.size();row += 4) {
+      if(trace) {
+	trace->append(&rows[row]);
+      } else if(output.is_open()) {
+	output << rows[row] << "\t" << rows[row + 1] << "\t" << rows[row + 2] << "\t" << rows[row + 3] << "\n";
+      }
+    }
+    rows.clear();
+  }
+
+  static string rateName(const Scalar blebbing, const Scalar leftShift, const Scalar stimulation) {
+    stringstream name;
+    name << "blebbing_" << blebbing << "_left_shift_" << leftShift << "_stimulation_" << stimulation;
+    return name.str();
+  }
+
+  static RateRun startRun(const ExperimentSettings& settings, const Protocol& protocol, const string& name) {
+    RateRun run(settings, protocol, name);
+    if(!settings.initialState.empty()) {
+      ifstream input(settings.initialState.c_str(), ios::binary);
+      if(!run.neuron.restore(input)) {
+	cerr << settings.initialState << ": not a neuron snapshot" << endl;
+      }
+    }
+    run.neuron.setIntegrator(settings.integrator);
+    run.neuron.setRateTable(settings.rateTable);
+    return run;
+  }
+
+  // Runs run to the end, resuming from its checkpoint when one is further along.
+  static void finishRateExperiment(RateRun& run) {
+    const ExperimentSettings& settings = *run.settings;
+    HodgkinHuxley& neuron = run.neuron;
+    RunState& state = run.state;
+
+    const Scalar duration = run.protocol.getDuration();
+    const Scalar blebbing = run.getLabel(Protocol::Blebbing), leftShift = run.getLabel(Protocol::LeftShift),
+      stimulation = run.getLabel(Protocol::Stimulation);
+    stringstream nameStream;
+    nameStream << settings.directory << "/" << run.name;
+    const string checkpointPath = nameStream.str() + ".checkpoint";
+
+    bool resumed = false;
+    if(settings.checkpointInterval > 0) {
+      RateRun loaded(run);
+      if(loadCheckpoint(checkpointPath, loaded) && loaded.state.currentTime > state.currentTime) {
+	// The trace on disk already holds every row up to the checkpoint.
+	loaded.rows.clear();
+	run = loaded;
+	resumed = true;
+      }
+    }
+
+    ofstream output;
+    TraceWriter* trace = NULL;
+    if(settings.traceFormat == ExperimentSettings::Binary || settings.traceFormat == ExperimentSettings::Compressed) {
+      string path = nameStream.str() + ".trace";
+      if(resumed) {
+	trace = new TraceWriter(path, 4, state.traceOffset);
+	if(!trace->isOpen()) {
+	  delete trace;
+	  trace = NULL;
+	}
+      }
+      // A run that cannot continue its trace starts a fresh one, like the tab separated one below.
+      if(!trace) {
+	vector<string> names, units;
+	names.push_back("time");
+	units.push_back("ms");
+	names.push_back("potential");
+	units.push_back("mV");
+	names.push_back("potassium reversal potential");
+	units.push_back("mV");
+	names.push_back("sodium reversal potential");
+	units.push_back("mV");
+	trace = new TraceWriter(path, names, units, settings.neuron.toString(), 8192,
+				settings.traceFormat == ExperimentSettings::Compressed);
+      }
+    } else if(settings.traceFormat == ExperimentSettings::TabSeparated) {
+      string path = nameStream.str() + ".tsv";
+      if(resumed && truncate(path.c_str(), state.traceOffset) == 0) {
+	output.open(path.c_str(), ios::in | ios::out);
+	output.seekp(0, ios::end);
+      } else {
+	output.open(path.c_str());
+	output << "time (ms)\tpotential (mV)\tpotassium reversal potential (mv)\tsodium reversal potential (mv)" << endl;
+      }
+    }
+
+    time_t start = time(NULL);
+    Instrumentation::current().reset();
+    const Scalar startTime = state.currentTime;
+    const unsigned long acceptedSteps = neuron.getAcceptedSteps(), rejectedSteps = neuron.getRejectedSteps(),
+      rhsEvaluations = neuron.getRhsEvaluations();
+
+    Scalar nextCheckpoint = settings.checkpointInterval > 0 ? (floor(state.currentTime / settings.checkpointInterval) + 1) * settings.checkpointInterval : duration;
+    RunProgress* progress = settings.progress ? settings.progress->start(run.name, state.currentTime, duration) : NULL;
+    while (!run.isFinished()) {
+      const Scalar lastTime = state.currentTime;
+      {
+	HH_TIME(integratingSeconds);
+	run.step(duration);
+      }
+      if(progress) {
+	progress->update(state.currentTime, neuron.getAcceptedSteps() - acceptedSteps, neuron.getRejectedSteps() - rejectedSteps,
+			 state.currentTime - lastTime);
+      }
+      if(run.rows.size() >= 4096) {
+	writeRows(run.rows, trace, output);
+      }
+      if(run.hasSettled()) {
+	// The spikes the rest of the run would have had are the period repeated.
+	run.analyzer.extrapolate(run.detector.getPeriod(), duration);
+	break;
+      }
+
+      if(state.currentTime >= nextCheckpoint && !run.isFinished()) {
+	nextCheckpoint += settings.checkpointInterval * (floor((state.currentTime - nextCheckpoint) / settings.checkpointInterval) + 1);
+	// A resumed run starts decimating afresh, so this one does too.
+	run.decimator.flush(run.rows);
+	writeRows(run.rows, trace, output);
+	HH_TIME(writingSeconds);
+	if(trace) {
+	  state.traceOffset = trace->flush();
+	} else if(output.is_open()) {
+	  output.flush();
+	  state.traceOffset = output.tellp();
+	}
+	saveCheckpoint(checkpointPath, run);
+      }
+    }
+    if(progress) {
+      settings.progress->finish(progress);
+    }
+    run.decimator.flush(run.rows);
+    writeRows(run.rows, trace, output);
+
+    // Built up front so lines from concurrent runs do not interleave.
+    stringstream summary;
+    summary << run.name << " " << difftime(time(NULL), start)
+	    << " " << neuron.getAcceptedSteps() << " " << neuron.getRejectedSteps() << " " << neuron.getRhsEvaluations();
+    if(run.hasSettled()) {
+      summary << " " << (run.detector.getOutcome() == SteadyStateDetector::Rest ? "rest" : "periodic")
+	      << " from " << run.detector.getSettledTime();
+    }
+    summary << endl;
+    cout << summary.str() << flush;
+    {
+      HH_TIME(writingSeconds);
+      if(trace) {
+	trace->close();
+	delete trace;
+      } else if(output.is_open()) {
+	output.close();
+      }
+    }
+
+    if(Instrumentation::isEnabled()) {
+      string path = nameStream.str() + ".json";
+      ofstream report(path.c_str());
+      report.precision(17);
+      report << "{\n";
+      report << "  \"name\": \"" << run.name << "\",\n";
+      report << "  \"blebbing\": " << blebbing << ",\n";
+      report << "  \"leftShift\": " << leftShift << ",\n";
+      report << "  \"stimulation\": " << stimulation << ",\n";
+      report << "  \"startTime\": " << startTime << ",\n";
+      report << "  \"duration\": " << duration << ",\n";
+      report << "  \"acceptedSteps\": " << neuron.getAcceptedSteps() - acceptedSteps << ",\n";
+      report << "  \"rejectedSteps\": " << neuron.getRejectedSteps() - rejectedSteps << ",\n";
+      report << "  \"rhsEvaluations\": " << neuron.getRhsEvaluations() - rhsEvaluations << ",\n";
+      report << Instrumentation::current().toJson() << "\n";
+      report << "}\n";
+    }
+
+    stringstream line;
+    line << blebbing << "\t" << leftShift << "\t" << stimulation << "\t" << run.analyzer.summary(duration) << "\t"
+	 << difftime(time(NULL), start) << "\n";
+    appendSummary(settings, line.str());
+    if(settings.checkpointInterval > 0) {
+      remove(checkpointPath.c_str());
+    }
+  }
+
+  void rateExperiment(const ExperimentSettings& settings, const Scalar blebbing, const Scalar leftShift,
+		      const Scalar stimulation) {
+    RateRun run = startRun(settings, Protocol::standard(blebbing, leftShift, stimulation),
+			   rateName(blebbing, leftShift, stimulation));
+    finishRateExperiment(run);
+  }
+
+  void protocolExperiment(const ExperimentSettings& settings, const Protocol& protocol, const string& name) {
+    RateRun run = startRun(settings, protocol, name);
+    finishRateExperiment(run);
+  }
+
+  /*
+   * Every run sees the same parameters up to blebbingStart, and runs with the
+   * same blebbing and leftShift up to stimulationStart. Those prefixes are
+   * simulated once and the state forked into the runs that share them.
+   * finished is called with each run once it has been written.
+   */
+  static void runForked(const ExperimentSettings& settings, const vector<SweepPoint>& points, WorkStealingPool& pool,
+			const function<void(const SweepPoint&, const RateRun&)>& finished) {
+    map<pair<Scalar, Scalar>, vector<SweepPoint> > groups;
+    for(size_t i = 0;i < points.size();i++) {
+      groups[make_pair(points[i].blebbing, points[i].leftShift)].push_back(points[i]);
+    }
+    if(groups.empty()) {
+      return;
+    }
+
+    RateRun root = startRun(settings, Protocol::standard(0, 0, 0), "");
+    root.runUntil(blebbingStart);
+
+    WorkStealingPool* workers = &pool;
+    for(map<pair<Scalar, Scalar>, vector<SweepPoint> >::const_iterator group = groups.begin();group != groups.end();group++) {
+      RateRun prefix(root);
+      prefix.setProtocol(Protocol::standard(group->first.first, group->first.second, 0), "");
+      vector<SweepPoint> points = group->second;
+      pool.submit([prefix, points, workers, finished]() mutable {
+	  prefix.runUntil(stimulationStart);
+	  for(size_t i = 0;i < points.size();i++) {
+	    RateRun branch(prefix);
+	    SweepPoint point = points[i];
+	    branch.setProtocol(Protocol::standard(point.blebbing, point.leftShift, point.stimulation),
+			       rateName(point.blebbing, point.leftShift, point.stimulation));
+	    workers->submit([branch, point, finished]() mutable {
+		finishRateExperiment(branch);
+		finished(point, branch);
+	      });
+	  }
+	});
+    }
+    pool.wait();
+  }
+
+  int forkedRateExperiment(const ExperimentSettings& settings, Sweep& sweep, WorkStealingPool& pool) {
+    vector<SweepPoint> points;
+    for(size_t i = 0;i < sweep.getPoints().size();i++) {
+      if(!sweep.isFinished(sweep.getPoints()[i])) {
+	points.push_back(sweep.getPoints()[i]);
+      }
+    }
+    if(settings.progress) {
+      settings.progress->expect(points.size());
+    }
+    Sweep* journal = &sweep;
+    runForked(settings, points, pool, [journal](const SweepPoint& point, const RateRun&) {
+	journal->finish(point);
+      });
+    return points.size();
+  }
+
+  int refinedRateExperiment(const ExperimentSettings& settings, Refinement& refinement, WorkStealingPool& pool) {
+    int runs = 0;
+    Refinement* samples = &refinement;
+    for(vector<SweepPoint> points = refinement.next();!points.empty();points = refinement.next()) {
+      // The rounds to come are not known yet, so the estimate only covers this one.
+      if(settings.progress) {
+	settings.progress->expect(points.size());
+      }
+      runForked(settings, points, pool, [samples](const SweepPoint& point, const RateRun& run) {
+	  const Scalar end = run.protocol.getDuration();
+	  samples->record(point, Refinement::Sample(run.analyzer.getRate(end), run.analyzer.getRegime(end)));
+	});
+      runs += points.size();
+    }
+    return runs;
+  }
+
+  void batchRateExperiment(const ExperimentSettings& settings, const Scalar stimulation) {
+    vector<Scalar> blebbings, leftShifts;
+    for(int i = 0;i < 100;i++) {
+      for(int j = 0;j < 100;j++) {
+	blebbings.push_back(i * .01);
+	leftShifts.push_back(j * .4);
+      }
+    }
+    int lanes = blebbings.size();
+    HodgkinHuxleyBatch neurons(settings.neuron, lanes);
+    neurons.setNoise(settings.noise, settings.seed);
+
+    Scalar blebbingStart = 100, stimulationStart = 500, duration = 200500, countStart = duration - 5000, currentTime;
+    Scalar step = 10*settings.resolution;
+    vector<int> spikes(lanes, 0);
+
+    time_t start = time(NULL);
+    int limit = duration/step;
+    for (int i = 0; i < limit; i++) {
+      currentTime = i * step;
+      if(currentTime > blebbingStart) {
+	for(int lane = 0;lane < lanes;lane++) {
+	  neurons.setBlebbing(lane, blebbings[lane]);
+	  neurons.setLeftShift(lane, leftShifts[lane]);
+	  neurons.setStimulation(lane, currentTime > stimulationStart ? stimulation : 0);
+	}
+      }
+      neurons.simulate(step);
+      if(currentTime > countStart) {
+	for(int lane = 0;lane < lanes;lane++) {
+	  spikes[lane] += neurons.isSpiked(lane);
+	}
+      }
+    }
+
+    stringstream nameStream;
+    nameStream << settings.directory << "/batch_stimulation_" << stimulation << ".tsv";
+    ofstream output(nameStream.str().c_str());
+    output << "blebbing\tleft shift (mV)\trate (Hz)" << endl;
+    for(int lane = 0;lane < lanes;lane++) {
+      output << blebbings[lane] << "\t" << leftShifts[lane] << "\t" << spikes[lane] / ((duration - countStart) / 1000) << endl;
+    }
+    output.close();
+
+    cout << "batch " << lanes << " " << stimulation << " " << difftime(time(NULL), start) << endl;
+  }
+
+  /*
+   * An axon of size compartments, 10 µm long with a 0.5 µm radius, whose
+   * middle third is blebbed. The first compartment is stimulated, and the
+   * spikes reaching every compartment show whether the blebbed segment
+   * still conducts them.
+   */
+  void cableExperiment(const ExperimentSettings& settings, const int size, const Scalar blebbing, const Scalar leftShift,
+		       const Scalar stimulation) {
+    Cable cable(settings.neuron, size, .5, 10, 100);
+    Scalar duration = 2500, step = 10*settings.resolution;
+    vector<SpikeAnalyzer> analyzers(size, SpikeAnalyzer(settings.neuron.threshold, duration - stimulationStart));
+
+    time_t start = time(NULL);
+    long limit = llround(duration/step);
+    for(long i = 0;i < limit;i++) {
+      Scalar currentTime = i * step;
+      if(currentTime >= blebbingStart) {
+	for(int compartment = size / 3;compartment < 2 * size / 3;compartment++) {
+	  cable.setBlebbing(compartment, blebbing);
+	  cable.setLeftShift(compartment, leftShift);
+	}
+      }
+      cable.setStimulation(0, currentTime >= stimulationStart ? stimulation : 0);
+      cable.simulate(step);
+      for(int compartment = 0;compartment < size;compartment++) {
+	const HodgkinHuxley& neuron = cable.getCompartment(compartment);
+	analyzers[compartment].observe(currentTime, neuron.getLastPotential(), currentTime + step, neuron.getPotential());
+      }
+    }
+
+    stringstream nameStream;
+    nameStream << settings.directory << "/cable_" << size << "_" << blebbing << "_" << leftShift << "_" << stimulation << ".tsv";
+    ofstream output(nameStream.str().c_str());
+    output << "compartment\tblebbing\t" << SpikeAnalyzer::header() << endl;
+    for(int compartment = 0;compartment < size;compartment++) {
+      bool blebbed = compartment >= size / 3 && compartment < 2 * size / 3;
+      output << compartment << "\t" << (blebbed ? blebbing : 0) << "\t" << analyzers[compartment].summary(duration) << endl;
+    }
+    output.close();
+
+    if(settings.verbose) {
+      cout << "cable " << size << " " << blebbing << " " << leftShift << " " << stimulation << " "
+	   << difftime(time(NULL), start) << endl;
+    }
+  }
+
+  /*
+   * size neurons in pools extracellular pools, the first half of them
+   * blebbed, all stimulated from stimulationStart. Writes each pool's outer
+   * potassium and mean rate over the last second.
+   */
+  void networkExperiment(const ExperimentSettings& settings, const int size, const int pools, const Scalar diffusion,
+			 const Scalar blebbing, const Scalar leftShift, const Scalar stimulation, const int threads) {
+    Network network(settings.neuron, size, pools, diffusion, threads);
+    Scalar duration = 2500, countStart = duration - 1000, step = 10*settings.resolution, exchange = 1;
+
+    time_t start = time(NULL);
+    network.simulate(blebbingStart, step, exchange);
+    for(int neuron = 0;neuron < size / 2;neuron++) {
+      network.setBlebbing(neuron, blebbing);
+      network.setLeftShift(neuron, leftShift);
+    }
+    network.simulate(stimulationStart - blebbingStart, step, exchange);
+    for(int neuron = 0;neuron < size;neuron++) {
+      network.setStimulation(neuron, stimulation);
+    }
+    network.simulate(countStart - stimulationStart, step, exchange);
+    network.resetSpikeCounts();
+    network.simulate(duration - countStart, step, exchange);
+
+    vector<int> spikes(network.getPools(), 0), members(network.getPools(), 0);
+    for(int neuron = 0;neuron < size;neuron++) {
+      spikes[network.getPool(neuron)] += network.getSpikeCount(neuron);
+      members[network.getPool(neuron)]++;
+    }
+    stringstream nameStream;
+    nameStream << settings.directory << "/network_" << size << "_" << pools << "_" << diffusion << "_" << blebbing << "_"
+	       << leftShift << "_" << stimulation << ".tsv";
+    ofstream output(nameStream.str().c_str());
+    output << "pool\tneurons\touter potassium (mM)\trate (Hz)" << endl;
+    for(int pool = 0;pool < network.getPools();pool++) {
+      output << pool << "\t" << members[pool] << "\t"
+	     << network.getConcentration(pool, HodgkinHuxley::OuterPotassiumConcentration) << "\t"
+	     << spikes[pool] / (Scalar)members[pool] / ((duration - countStart) / 1000) << endl;
+    }
+    output.close();
+
+    if(settings.verbose) {
+      cout << "network " << size << " " << pools << " " << difftime(time(NULL), start) << endl;
+    }
+  }
+}
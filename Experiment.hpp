@@ -0,0 +1,61 @@
+#ifndef EXPERIMENT_HPP
+#define EXPERIMENT_HPP
+
+#include "HodgkinHuxley.hpp"
+#include <string>
+
+namespace Jarl {
+  class ProgressReporter;
+  class Protocol;
+  class RateTable;
+  class Refinement;
+  class Sweep;
+  class WorkStealingPool;
+
+  class ExperimentSettings {
+  public:
+    // Compressed is Binary encoded as TraceWriter describes.
+    enum TraceFormat { NoTrace, TabSeparated, Binary, Compressed };
+    ExperimentSettings();
+    HodgkinHuxley::Settings neuron;
+    HodgkinHuxley::Integrator integrator;
+    const RateTable* rateTable;
+    Scalar resolution;
+    Scalar maximumStep;
+    int writeResolution;
+    TraceFormat traceFormat;
+    // Above 0, every step is traced and a TraceDecimator keeps the rows needed to within this many mV.
+    Scalar traceTolerance;
+    Scalar rateWindow;
+    Scalar checkpointInterval;
+    // Ends a run once it has come to rest or onto a limit cycle, and reports the spikes it would have had.
+    bool earlyStop;
+    // Every run starts its noise from seed, so runs with different parameters see the same draws.
+    HodgkinHuxley::Noise noise;
+    uint64_t seed;
+    // Runs report how far they have got to it when it is set.
+    ProgressReporter* progress;
+    std::string initialState;
+    std::string directory;
+    bool verbose;
+  };
+
+  HodgkinHuxley::Settings referenceSettings();
+  void rateExperiment(const ExperimentSettings& settings, const Scalar blebbing, const Scalar leftShift,
+		      const Scalar stimulation);
+  // Runs protocol, naming its output files after name.
+  void protocolExperiment(const ExperimentSettings& settings, const Protocol& protocol, const std::string& name);
+  // Runs the unfinished points of sweep like rateExperiment, simulating the history they share only once.
+  int forkedRateExperiment(const ExperimentSettings& settings, Sweep& sweep, WorkStealingPool& pool);
+  // Runs the points refinement asks for, round after round, until it has refined the map; returns the runs it took.
+  int refinedRateExperiment(const ExperimentSettings& settings, Refinement& refinement, WorkStealingPool& pool);
+  void batchRateExperiment(const ExperimentSettings& settings, const Scalar stimulation);
+  // Conduction of spikes started at one end of an axon of size compartments through a blebbed segment.
+  void cableExperiment(const ExperimentSettings& settings, const int size, const Scalar blebbing, const Scalar leftShift,
+		       const Scalar stimulation);
+  // Neurons exchanging potassium and sodium through shared extracellular pools, stepped on threads.
+  void networkExperiment(const ExperimentSettings& settings, const int size, const int pools, const Scalar diffusion,
+			 const Scalar blebbing, const Scalar leftShift, const Scalar stimulation, const int threads);
+}
+
+#endif
@@ -1,71 +1,28 @@
 #include "HodgkinHuxley.hpp"
+#include "Instrumentation.hpp"
+#include "Philox.hpp"
+#include "RateFunctions.hpp"
+#include "RateTable.hpp"
+#include "Serialization.hpp"
 #include <math.h>
 #include <algorithm>
 #include <sstream>
+#include <string.h>
+#include <vector>
 
 using namespace std;
 
 namespace Jarl {
+  static const char snapshotMagic[8] = {'H', 'H', 'S', 'N', 'A', 'P', '\0', '\0'};
+  static const uint32_t snapshotVersion = 3;
+
   const Scalar potassiumDissociationConstant = 3.5;
   const Scalar sodiumDissociationConstant = 10;
   const Scalar gasConstant = 8.314472;
   const Scalar faradayConstant = 96485.3399;
-
-  Scalar alphaN(const Scalar potential) {
-    if(potential == -55) {
-      return .1;
-    } else {
-      return .01 * (potential + 55) / (1 - exp(-(potential + 55) / 10));
-    }
-  }
-
-  Scalar betaN(const Scalar potential) {
-    return .125 * exp(-(potential + 65) / 80);
-  }
-
-  Scalar infinityN(const Scalar potential) {
-    return alphaN(potential) / (alphaN(potential) + betaN(potential));
-  }
-
-  Scalar derivativeN(const Scalar potential, const Scalar n) {
-    return alphaN(potential) * (1 - n) - betaN(potential) * n;
-  }
-
-  Scalar alphaM(const Scalar potential) {
-    if(potential == -40) {
-      return 1;
-    } else {
-      return .1 * (potential + 40) / (1 - exp(-(potential + 40) / 10));
-    }
-  }
-
-  Scalar betaM(const Scalar potential) {
-    return 4 * exp(-(potential + 65) / 18);
-  }
-
-  Scalar infinityM(const Scalar potential) {
-    return alphaM(potential) / (alphaM(potential) + betaM(potential));
-  }
-
-  Scalar derivativeM(const Scalar potential, const Scalar m) {
-    return alphaM(potential) * (1 - m) - betaM(potential) * m;
-  }
-
-  Scalar alphaH(const Scalar potential) {
-    return .07 * exp(-(potential + 65) / 20);
-  }
-
-  Scalar betaH(const Scalar potential) {
-    return 1 / (1 + exp(-(potential + 35) / 10));
-  }
-
-  Scalar infinityH(const Scalar potential) {
-    return alphaH(potential) / (alphaH(potential) + betaH(potential));
-  }
-
-  Scalar derivativeH(const Scalar potential, const Scalar h) {
-    return alphaH(potential) * (1 - h) - betaH(potential) * h;
-  }
+  // 18 and 60 per µm², the squid axon densities of Schneidman, Freedman and Segev, Neural Comput 10 (1998).
+  const Scalar potassiumChannelDensity = 1.8e9;
+  const Scalar sodiumChannelDensity = 6e9;
 
   HodgkinHuxley::Settings::Settings() {
     maxPumpCurrent = 0;
@@ -76,6 +33,35 @@ namespace Jarl {
     stimulation = 0;
   }
 
+  string HodgkinHuxley::Settings::toString() const {
+    stringstream stream;
+    stream.precision(17);
+    stream << "potential\t" << potential << endl;
+    stream << "capacitance\t" << capacitance << endl;
+    stream << "leakConductance\t" << leakConductance << endl;
+    stream << "leakReversalPotential\t" << leakReversalPotential << endl;
+    stream << "potassiumConductance\t" << potassiumConductance << endl;
+    stream << "potassiumReversalPotential\t" << potassiumReversalPotential << endl;
+    stream << "sodiumConductance\t" << sodiumConductance << endl;
+    stream << "sodiumReversalPotential\t" << sodiumReversalPotential << endl;
+    stream << "maxPumpCurrent\t" << maxPumpCurrent << endl;
+    stream << "innerPotassiumConcentration\t" << innerPotassiumConcentration << endl;
+    stream << "outerPotassiumConcentration\t" << outerPotassiumConcentration << endl;
+    stream << "innerSodiumConcentration\t" << innerSodiumConcentration << endl;
+    stream << "outerSodiumConcentration\t" << outerSodiumConcentration << endl;
+    stream << "surfaceArea\t" << surfaceArea << endl;
+    stream << "innerVolume\t" << innerVolume << endl;
+    stream << "outerVolume\t" << outerVolume << endl;
+    stream << "temperature\t" << temperature << endl;
+    stream << "threshold\t" << threshold << endl;
+    stream << "potassiumLeakConductance\t" << potassiumLeakConductance << endl;
+    stream << "sodiumLeakConductance\t" << sodiumLeakConductance << endl;
+    stream << "blebbing\t" << blebbing << endl;
+    stream << "leftShift\t" << leftShift << endl;
+    stream << "stimulation\t" << stimulation << endl;
+    return stream.str();
+  }
+
   class HodgkinHuxley::Private {
   public:
     Scalar potential;
@@ -108,6 +94,32 @@ namespace Jarl {
     Scalar blebbedH;
     Scalar lastPotential;
     Scalar stimulation;
+    HodgkinHuxley::Integrator integrator;
+    Scalar absoluteTolerance[Variables];
+    Scalar relativeTolerance[Variables];
+    Scalar nextStep;
+    Scalar lastError;
+    Scalar rate[Variables];
+    bool rateValid;
+    unsigned long acceptedSteps;
+    unsigned long rejectedSteps;
+    unsigned long rhsEvaluations;
+    const RateTable* rateTable;
+    HodgkinHuxley::Noise noise;
+    uint64_t seed;
+    // Noisy steps since setNoise, the step of the counter the draws are made at.
+    uint64_t noiseSteps;
+    // At the concentrations of linearizedAt, see linearize.
+    Scalar pumpBaseCurrent;
+    Scalar linearizedAt[Variables];
+    Scalar reversalSlope[Variables];
+    Scalar pumpSlope[Variables];
+    Scalar macroTolerance;
+    typedef void (Private::*Derivative)(const Scalar* y, Scalar* dy) const;
+    typedef Scalar (Private::*Step)(const Scalar time, const Scalar limit, const bool force);
+    HodgkinHuxley::Precision precision;
+    Derivative derivativeKernel;
+    Step rungeKuttaKernel;
 
     Private(const Settings& settings) {
       potential = settings.potential;
@@ -140,266 +152,857 @@ namespace Jarl {
       blebbedN = infinityN(potential + leftShift);
       blebbedM = infinityM(potential + leftShift);
       blebbedH = infinityH(potential + leftShift);
+      lastPotential = potential;
+
+      integrator = RungeKutta;
+      for(int i = 0;i < Variables;i++) {
+	absoluteTolerance[i] = 1e-6;
+	relativeTolerance[i] = 1e-6;
+      }
+      absoluteTolerance[Potential] = 1e-4;
+      nextStep = 1e-3;
+      lastError = 1e-4;
+      rateValid = false;
+      acceptedSteps = 0;
+      rejectedSteps = 0;
+      rhsEvaluations = 0;
+      rateTable = NULL;
+      noise = Deterministic;
+      seed = 0;
+      noiseSteps = 0;
+      macroTolerance = 1e-5;
+      getState(linearizedAt);
+      pumpBaseCurrent = 0;
+      for(int i = 0;i < Variables;i++) {
+	reversalSlope[i] = 0;
+	pumpSlope[i] = 0;
+      }
+      precision = Double;
+      selectKernels();
+    }
+
+    template<typename Real>
+    Real alphaN(const Real potential) const {
+      return rateTable ? Real(rateTable->alphaN(potential)) : Jarl::alphaN(potential);
+    }
+
+    template<typename Real>
+    Real betaN(const Real potential) const {
+      return rateTable ? Real(rateTable->betaN(potential)) : Jarl::betaN(potential);
+    }
+
+    template<typename Real>
+    Real alphaM(const Real potential) const {
+      return rateTable ? Real(rateTable->alphaM(potential)) : Jarl::alphaM(potential);
+    }
+
+    template<typename Real>
+    Real betaM(const Real potential) const {
+      return rateTable ? Real(rateTable->betaM(potential)) : Jarl::betaM(potential);
     }
 
-    Scalar getLeakCurrent(const Scalar potential) {
-      return leakConductance * (potential - leakReversalPotential);
+    template<typename Real>
+    Real alphaH(const Real potential) const {
+      return rateTable ? Real(rateTable->alphaH(potential)) : Jarl::alphaH(potential);
     }
 
+    template<typename Real>
+    Real betaH(const Real potential) const {
+      return rateTable ? Real(rateTable->betaH(potential)) : Jarl::betaH(potential);
+    }
+
+    template<typename Real>
+    Real derivativeN(const Real potential, const Real n) const {
+      return gateDerivative(alphaN(potential), betaN(potential), n);
+    }
+
+    template<typename Real>
+    Real derivativeM(const Real potential, const Real m) const {
+      return gateDerivative(alphaM(potential), betaM(potential), m);
+    }
+
+    template<typename Real>
+    Real derivativeH(const Real potential, const Real h) const {
+      return gateDerivative(alphaH(potential), betaH(potential), h);
+    }
+
+    // Without Blebbing the blebbed gates move like the others, see selectKernels.
+    template<bool Blebbing, typename Real>
+    void gateDerivatives(const Real* y, Real* dy) const {
+      dy[N] = derivativeN(y[Potential], y[N]);
+      dy[M] = derivativeM(y[Potential], y[M]);
+      dy[H] = derivativeH(y[Potential], y[H]);
+      if(Blebbing) {
+	dy[BlebbedM] = derivativeM(y[Potential] + Real(leftShift), y[BlebbedM]);
+	dy[BlebbedH] = derivativeH(y[Potential] + Real(leftShift), y[BlebbedH]);
+      } else {
+	dy[BlebbedM] = dy[M];
+	dy[BlebbedH] = dy[H];
+      }
+    }
+
+    // In Scalar the exponentials of every rate are taken in one MathKernels call.
+    template<bool Blebbing>
+    void gateDerivatives(const Scalar* y, Scalar* dy) const {
+      if(rateTable) {
+	gateDerivatives<Blebbing, Scalar>(y, dy);
+	return;
+      }
+      Scalar rates[Rates + 4];
+      gateRates<Blebbing>(y[Potential], y[Potential] + leftShift, rates);
+      dy[N] = gateDerivative(rates[AlphaN], rates[BetaN], y[N]);
+      dy[M] = gateDerivative(rates[AlphaM], rates[BetaM], y[M]);
+      dy[H] = gateDerivative(rates[AlphaH], rates[BetaH], y[H]);
+      if(Blebbing) {
+	dy[BlebbedM] = gateDerivative(rates[Rates], rates[Rates + 1], y[BlebbedM]);
+	dy[BlebbedH] = gateDerivative(rates[Rates + 2], rates[Rates + 3], y[BlebbedH]);
+      } else {
+	dy[BlebbedM] = dy[M];
+	dy[BlebbedH] = dy[H];
+      }
+    }
 
-    Scalar getPotassiumCurrent(const Scalar potential, const Scalar n,
-			       Scalar reversalPotential) {
-      return potassiumConductance * n * n * n * n
+    template<typename Real>
+    Real getLeakCurrent(const Real potential) const {
+      return Real(leakConductance) * (potential - Real(leakReversalPotential));
+    }
+
+
+    template<typename Real>
+    Real getPotassiumCurrent(const Real potential, const Real n,
+			     const Real reversalPotential) const {
+      return Real(potassiumConductance) * n * n * n * n
 	* (potential - reversalPotential);
     }
 
-    Scalar getPotassiumPumpLeakCurrent(const Scalar potential,
-				       Scalar reversalPotential) {
-      return potassiumLeakConductance * (potential - reversalPotential);
+    template<typename Real>
+    Real getPotassiumPumpLeakCurrent(const Real potential,
+				     const Real reversalPotential) const {
+      return Real(potassiumLeakConductance) * (potential - reversalPotential);
     }
 
-    Scalar getTotalPotassiumCurrent(const Scalar potential, const Scalar n,
-				    Scalar reversalPotential, const Scalar pumpBaseCurrent) {
+    template<typename Real>
+    Real getTotalPotassiumCurrent(const Real potential, const Real n,
+				  const Real reversalPotential, const Real pumpBaseCurrent) const {
       return getPotassiumCurrent(potential, n, reversalPotential) - 2
 	* pumpBaseCurrent
 	+ getPotassiumPumpLeakCurrent(potential, reversalPotential);
     }
 
-    Scalar getSodiumCurrent(const Scalar potential, const Scalar m, const Scalar h, const Scalar blebbedM, const Scalar blebbedH,
-			    Scalar reversalPotential) {
-      return sodiumConductance * (m * m * m * h * (1 - blebbing) + blebbedM * blebbedM * blebbedM * blebbedH * blebbing)
+    // Without Blebbing only the unblebbed channels conduct, which is what blebbing == 0 gives exactly.
+    template<typename Real, bool Blebbing = true>
+    Real getSodiumCurrent(const Real potential, const Real m, const Real h, const Real blebbedM, const Real blebbedH,
+			  const Real reversalPotential) const {
+      if(!Blebbing) {
+	return Real(sodiumConductance) * (m * m * m * h) * (potential - reversalPotential);
+      }
+      return Real(sodiumConductance) * (m * m * m * h * (1 - Real(blebbing)) + blebbedM * blebbedM * blebbedM * blebbedH * Real(blebbing))
 	* (potential - reversalPotential);
     }
 
-    Scalar getSodiumPumpLeakCurrent(const Scalar potential,
-				    Scalar reversalPotential) {
-      return sodiumLeakConductance * (potential - reversalPotential);
+    template<typename Real>
+    Real getSodiumPumpLeakCurrent(const Real potential,
+				  const Real reversalPotential) const {
+      return Real(sodiumLeakConductance) * (potential - reversalPotential);
     }
 
-    Scalar getTotalSodiumCurrent(const Scalar potential, const Scalar m, const Scalar h, const Scalar blebbedM, const Scalar blebbedH,
-				 Scalar reversalPotential, const Scalar pumpBaseCurrent) {
-      return getSodiumCurrent(potential, m, h, blebbedM, blebbedH, reversalPotential) + 3
+    template<typename Real, bool Blebbing = true>
+    Real getTotalSodiumCurrent(const Real potential, const Real m, const Real h, const Real blebbedM, const Real blebbedH,
+			       const Real reversalPotential, const Real pumpBaseCurrent) const {
+      return getSodiumCurrent<Real, Blebbing>(potential, m, h, blebbedM, blebbedH, reversalPotential) + 3
 	* pumpBaseCurrent
 	+ getSodiumPumpLeakCurrent(potential, reversalPotential);
     }
 
-    Scalar getPumpBaseCurrent(const Scalar outerPotassiumConcentration,
-			      Scalar innerSodiumConcentration) {
-      Scalar potassiumTemp = 1 + potassiumDissociationConstant/outerPotassiumConcentration;
-      Scalar sodiumTemp = 1 + sodiumDissociationConstant/innerSodiumConcentration;
-      return maxPumpCurrent/(potassiumTemp*potassiumTemp*sodiumTemp*sodiumTemp*sodiumTemp);
+    template<typename Real>
+    Real getPumpBaseCurrent(const Real outerPotassiumConcentration,
+			    const Real innerSodiumConcentration) const {
+      Real potassiumTemp = 1 + Real(potassiumDissociationConstant)/outerPotassiumConcentration;
+      Real sodiumTemp = 1 + Real(sodiumDissociationConstant)/innerSodiumConcentration;
+      return Real(maxPumpCurrent)/(potassiumTemp*potassiumTemp*sodiumTemp*sodiumTemp*sodiumTemp);
     }
 
-    Scalar derivativeInnerConcentration(const Scalar current) {
-      return -1e-6 * current * surfaceArea / faradayConstant / innerVolume;
+    template<typename Real>
+    Real derivativeInnerConcentration(const Real current) const {
+      return Real(-1e-6) * current * Real(surfaceArea) / Real(faradayConstant) / Real(innerVolume);
     }
 	
-    Scalar derivativeOuterConcentration(const Scalar current) {
-      return 1e-6 * current * surfaceArea / faradayConstant / outerVolume;
+    template<typename Real>
+    Real derivativeOuterConcentration(const Real current) const {
+      return Real(1e-6) * current * Real(surfaceArea) / Real(faradayConstant) / Real(outerVolume);
+    }
+
+    template<typename Real>
+    Real calculateReversalPotential(const Real innerConcentration, const Real outerConcentration) const {
+      HH_COUNT(logarithms, 1);
+      return -Real(gasConstant) * Real(temperature) / Real(faradayConstant) * 1000 * log(innerConcentration / outerConcentration);
     }
 
-    Scalar calculateReversalPotential(const Scalar innerConcentration, const Scalar outerConcentration) {
-      return -gasConstant * temperature / faradayConstant * 1000 * log(innerConcentration / outerConcentration);
+    // Every Scalar of the state in snapshot order. New fields only ever go at the end.
+    vector<Scalar*> snapshotFields() {
+      vector<Scalar*> fields;
+      fields.push_back(&potential);
+      fields.push_back(&capacitance);
+      fields.push_back(&leakConductance);
+      fields.push_back(&leakReversalPotential);
+      fields.push_back(&potassiumConductance);
+      fields.push_back(&potassiumReversalPotential);
+      fields.push_back(&sodiumConductance);
+      fields.push_back(&sodiumReversalPotential);
+      fields.push_back(&maxPumpCurrent);
+      fields.push_back(&innerPotassiumConcentration);
+      fields.push_back(&outerPotassiumConcentration);
+      fields.push_back(&innerSodiumConcentration);
+      fields.push_back(&outerSodiumConcentration);
+      fields.push_back(&surfaceArea);
+      fields.push_back(&innerVolume);
+      fields.push_back(&outerVolume);
+      fields.push_back(&temperature);
+      fields.push_back(&threshold);
+      fields.push_back(&potassiumLeakConductance);
+      fields.push_back(&sodiumLeakConductance);
+      fields.push_back(&blebbing);
+      fields.push_back(&leftShift);
+      fields.push_back(&n);
+      fields.push_back(&m);
+      fields.push_back(&h);
+      fields.push_back(&blebbedN);
+      fields.push_back(&blebbedM);
+      fields.push_back(&blebbedH);
+      fields.push_back(&lastPotential);
+      fields.push_back(&stimulation);
+      fields.push_back(&nextStep);
+      fields.push_back(&lastError);
+      for(int i = 0;i < Variables;i++) {
+	fields.push_back(&absoluteTolerance[i]);
+	fields.push_back(&relativeTolerance[i]);
+      }
+      fields.push_back(&macroTolerance);
+      for(int i = InnerPotassiumConcentration;i <= OuterSodiumConcentration;i++) {
+	fields.push_back(&linearizedAt[i]);
+      }
+      return fields;
+    }
+
+    template<typename Real>
+    void getState(Real* y) const {
+      y[Potential] = potential;
+      y[N] = n;
+      y[M] = m;
+      y[H] = h;
+      y[BlebbedM] = blebbedM;
+      y[BlebbedH] = blebbedH;
+      y[InnerPotassiumConcentration] = innerPotassiumConcentration;
+      y[OuterPotassiumConcentration] = outerPotassiumConcentration;
+      y[InnerSodiumConcentration] = innerSodiumConcentration;
+      y[OuterSodiumConcentration] = outerSodiumConcentration;
+    }
+
+    // Without concentrations, the reversal potentials are known not to have changed.
+    template<typename Real>
+    void setState(const Real* y, const bool concentrations = true) {
+      lastPotential = potential;
+      potential = y[Potential];
+      n = y[N];
+      m = y[M];
+      h = y[H];
+      blebbedM = y[BlebbedM];
+      blebbedH = y[BlebbedH];
+      innerPotassiumConcentration = y[InnerPotassiumConcentration];
+      outerPotassiumConcentration = y[OuterPotassiumConcentration];
+      innerSodiumConcentration = y[InnerSodiumConcentration];
+      outerSodiumConcentration = y[OuterSodiumConcentration];
+      if(concentrations && integrator == HodgkinHuxley::Multirate) {
+	getState(linearizedAt);
+	linearize();
+      } else if(concentrations) {
+	potassiumReversalPotential = calculateReversalPotential(innerPotassiumConcentration, outerPotassiumConcentration);
+	sodiumReversalPotential = calculateReversalPotential(innerSodiumConcentration, outerSodiumConcentration);
+      }
+    }
+
+    /*
+     * The reversal potentials and pump at the concentrations of
+     * linearizedAt, with their slopes in each concentration there, which
+     * is all Multirate needs of them between macro steps. Only Multirate
+     * keeps these up to date.
+     */
+    void linearize() {
+      const Scalar scale = gasConstant * temperature / faradayConstant * 1000;
+      potassiumReversalPotential = calculateReversalPotential(linearizedAt[InnerPotassiumConcentration],
+							      linearizedAt[OuterPotassiumConcentration]);
+      sodiumReversalPotential = calculateReversalPotential(linearizedAt[InnerSodiumConcentration],
+							   linearizedAt[OuterSodiumConcentration]);
+      pumpBaseCurrent = getPumpBaseCurrent(linearizedAt[OuterPotassiumConcentration], linearizedAt[InnerSodiumConcentration]);
+      for(int i = 0;i < Variables;i++) {
+	reversalSlope[i] = 0;
+	pumpSlope[i] = 0;
+      }
+      reversalSlope[InnerPotassiumConcentration] = -scale / linearizedAt[InnerPotassiumConcentration];
+      reversalSlope[OuterPotassiumConcentration] = scale / linearizedAt[OuterPotassiumConcentration];
+      reversalSlope[InnerSodiumConcentration] = -scale / linearizedAt[InnerSodiumConcentration];
+      reversalSlope[OuterSodiumConcentration] = scale / linearizedAt[OuterSodiumConcentration];
+      pumpSlope[OuterPotassiumConcentration] = 2 * pumpBaseCurrent * potassiumDissociationConstant
+	/ (linearizedAt[OuterPotassiumConcentration] * (linearizedAt[OuterPotassiumConcentration] + potassiumDissociationConstant));
+      pumpSlope[InnerSodiumConcentration] = 3 * pumpBaseCurrent * sodiumDissociationConstant
+	/ (linearizedAt[InnerSodiumConcentration] * (linearizedAt[InnerSodiumConcentration] + sodiumDissociationConstant));
+    }
+
+    template<typename Real>
+    Real linearizedReversalPotential(const Real reversalPotential, const Real* y, const int inner, const int outer) const {
+      return reversalPotential + Real(reversalSlope[inner]) * (y[inner] - Real(linearizedAt[inner]))
+	+ Real(reversalSlope[outer]) * (y[outer] - Real(linearizedAt[outer]));
+    }
+
+    template<typename Real>
+    Real linearizedPumpBaseCurrent(const Real* y) const {
+      return Real(pumpBaseCurrent)
+	+ Real(pumpSlope[OuterPotassiumConcentration]) * (y[OuterPotassiumConcentration] - Real(linearizedAt[OuterPotassiumConcentration]))
+	+ Real(pumpSlope[InnerSodiumConcentration]) * (y[InnerSodiumConcentration] - Real(linearizedAt[InnerSodiumConcentration]));
+    }
+
+    /*
+     * Right hand side of the model in Real. Each flag switched off drops
+     * terms that are exactly zero for the current parameters, see
+     * selectKernels, so every variant agrees with the full model. With
+     * Linearized the reversal potentials and pump come from linearize
+     * instead of a logarithm and a division, as Multirate steps with.
+     */
+    template<typename Real, bool Blebbing, bool Pump, bool Concentrations, bool Linearized = false>
+    void derivative(const Real* y, Real* dy) const {
+      Real potassiumReversalPotential = this->potassiumReversalPotential;
+      Real sodiumReversalPotential = this->sodiumReversalPotential;
+      if(Concentrations && Linearized) {
+	potassiumReversalPotential = linearizedReversalPotential(potassiumReversalPotential, y, InnerPotassiumConcentration,
+								 OuterPotassiumConcentration);
+	sodiumReversalPotential = linearizedReversalPotential(sodiumReversalPotential, y, InnerSodiumConcentration,
+							      OuterSodiumConcentration);
+      } else if(Concentrations) {
+	potassiumReversalPotential = calculateReversalPotential(y[InnerPotassiumConcentration], y[OuterPotassiumConcentration]);
+	sodiumReversalPotential = calculateReversalPotential(y[InnerSodiumConcentration], y[OuterSodiumConcentration]);
+      }
+      Real pumpBaseCurrent = 0;
+      if(Pump && Concentrations && Linearized) {
+	pumpBaseCurrent = linearizedPumpBaseCurrent(y);
+      } else if(Pump) {
+	pumpBaseCurrent = getPumpBaseCurrent(y[OuterPotassiumConcentration], y[InnerSodiumConcentration]);
+      }
+      Real potassiumCurrent = getTotalPotassiumCurrent(y[Potential], y[N], potassiumReversalPotential, pumpBaseCurrent);
+      Real sodiumCurrent = getTotalSodiumCurrent<Real, Blebbing>(y[Potential], y[M], y[H], y[BlebbedM], y[BlebbedH],
+								 sodiumReversalPotential, pumpBaseCurrent);
+      Real leakCurrent = getLeakCurrent(y[Potential]);
+      Real totalCurrent = potassiumCurrent + sodiumCurrent + leakCurrent + Real(stimulation);
+      dy[Potential] = -totalCurrent / Real(capacitance);
+      gateDerivatives<Blebbing>(y, dy);
+      if(Concentrations) {
+	dy[InnerPotassiumConcentration] = derivativeInnerConcentration(potassiumCurrent);
+	dy[OuterPotassiumConcentration] = derivativeOuterConcentration(potassiumCurrent);
+	dy[InnerSodiumConcentration] = derivativeInnerConcentration(sodiumCurrent);
+	dy[OuterSodiumConcentration] = derivativeOuterConcentration(sodiumCurrent);
+      } else {
+	dy[InnerPotassiumConcentration] = 0;
+	dy[OuterPotassiumConcentration] = 0;
+	dy[InnerSodiumConcentration] = 0;
+	dy[OuterSodiumConcentration] = 0;
+      }
+    }
+
+    // The right hand side the adaptive integrators step with, through the variant selectKernels picked.
+    void derivative(const Scalar* y, Scalar* dy) {
+      rhsEvaluations++;
+      (this->*derivativeKernel)(y, dy);
+    }
+
+    /*
+     * The classic fourth order Runge-Kutta step of HodgkinHuxley::simulate,
+     * computed in Real. change is a sixth of the largest relative change of
+     * the potential and gates, and the step is only kept if change is below
+     * limit or force is set.
+     */
+    template<typename Real, bool Blebbing, bool Pump, bool Concentrations>
+    Scalar rungeKutta(const Scalar time, const Scalar limit, const bool force) {
+      static const int changing[] = {N, M, H, BlebbedM, BlebbedH, Potential};
+      const Real step = time;
+      Real y[Variables], stage[Variables], k[4][Variables], sum[Variables];
+      getState(y);
+      rhsEvaluations += 4;
+
+      derivative<Real, Blebbing, Pump, Concentrations>(y, k[0]);
+      for(int i = 0;i < Variables;i++) {
+	k[0][i] = step * k[0][i];
+      }
+      for(int j = 1;j < 4;j++) {
+	for(int i = 0;i < Variables;i++) {
+	  stage[i] = j < 3 ? y[i] + k[j - 1][i]/2 : y[i] + k[j - 1][i];
+	}
+	derivative<Real, Blebbing, Pump, Concentrations>(stage, k[j]);
+	for(int i = 0;i < Variables;i++) {
+	  k[j][i] = step * k[j][i];
+	}
+      }
+
+      Real change = 0;
+      for(int i = 0;i < Variables;i++) {
+	sum[i] = k[0][i] + 2*k[1][i] + 2*k[2][i] + k[3][i];
+      }
+      for(int i = 0;i < 6;i++) {
+	change = max<Real>(change, fabs(sum[changing[i]]/y[changing[i]]));
+      }
+      change /= 6;
+
+      if(change < limit || force) {
+	for(int i = 0;i < Variables;i++) {
+	  y[i] += sum[i]/6;
+	}
+	setState(y, Concentrations);
+	rateValid = false;
+	acceptedSteps++;
+	if(noise != Deterministic) {
+	  addNoise(time);
+	}
+      } else {
+	rejectedSteps++;
+      }
+      return change;
+    }
+
+    /*
+     * Points the kernels at the cheapest variants that are exact for the
+     * current parameters. The blebbed gates obey the same equations as m and
+     * h when leftShift is zero, so once equal they stay equal and only
+     * matter when blebbing is not zero. Without a pump its current is zero,
+     * and without membrane area no current moves the concentrations.
+     */
+    void selectKernels() {
+      const bool blebbing = !(this->blebbing == 0 && leftShift == 0 && blebbedM == m && blebbedH == h);
+      const bool pump = maxPumpCurrent != 0;
+      const bool concentrations = surfaceArea != 0;
+      if(!concentrations) {
+	potassiumReversalPotential = calculateReversalPotential(innerPotassiumConcentration, outerPotassiumConcentration);
+	sodiumReversalPotential = calculateReversalPotential(innerSodiumConcentration, outerSodiumConcentration);
+      }
+      const int variant = blebbing * 4 + pump * 2 + concentrations;
+      static const Derivative derivatives[8] = {
+	&Private::derivative<Scalar, false, false, false>, &Private::derivative<Scalar, false, false, true>,
+	&Private::derivative<Scalar, false, true, false>, &Private::derivative<Scalar, false, true, true>,
+	&Private::derivative<Scalar, true, false, false>, &Private::derivative<Scalar, true, false, true>,
+	&Private::derivative<Scalar, true, true, false>, &Private::derivative<Scalar, true, true, true>
+      };
+      static const Derivative linearizedDerivatives[8] = {
+	&Private::derivative<Scalar, false, false, false, true>, &Private::derivative<Scalar, false, false, true, true>,
+	&Private::derivative<Scalar, false, true, false, true>, &Private::derivative<Scalar, false, true, true, true>,
+	&Private::derivative<Scalar, true, false, false, true>, &Private::derivative<Scalar, true, false, true, true>,
+	&Private::derivative<Scalar, true, true, false, true>, &Private::derivative<Scalar, true, true, true, true>
+      };
+      derivativeKernel = integrator == HodgkinHuxley::Multirate ? linearizedDerivatives[variant] : derivatives[variant];
+      if(precision == Single) {
+	rungeKuttaKernel = rungeKuttaKernels<float>()[variant];
+      } else if(precision == Extended) {
+	rungeKuttaKernel = rungeKuttaKernels<long double>()[variant];
+      } else {
+	rungeKuttaKernel = rungeKuttaKernels<double>()[variant];
+      }
+    }
+
+    template<typename Real>
+    static const Step* rungeKuttaKernels() {
+      static const Step kernels[8] = {
+	&Private::rungeKutta<Real, false, false, false>, &Private::rungeKutta<Real, false, false, true>,
+	&Private::rungeKutta<Real, false, true, false>, &Private::rungeKutta<Real, false, true, true>,
+	&Private::rungeKutta<Real, true, false, false>, &Private::rungeKutta<Real, true, false, true>,
+	&Private::rungeKutta<Real, true, true, false>, &Private::rungeKutta<Real, true, true, true>
+      };
+      return kernels;
+    }
+
+    /*
+     * The membrane at state y with the gates and concentrations frozen, as a
+     * linear RC circuit: the ionic, pump and stimulation currents together
+     * are conductance * (potential - steadyPotential).
+     */
+    class Membrane {
+    public:
+      Membrane(const Private& neuron, const Scalar* y) {
+	potassiumReversalPotential = neuron.calculateReversalPotential(y[InnerPotassiumConcentration],
+								       y[OuterPotassiumConcentration]);
+	sodiumReversalPotential = neuron.calculateReversalPotential(y[InnerSodiumConcentration],
+								    y[OuterSodiumConcentration]);
+	pumpBaseCurrent = neuron.getPumpBaseCurrent(y[OuterPotassiumConcentration], y[InnerSodiumConcentration]);
+	Scalar potassiumConductanceTotal = neuron.potassiumConductance * y[N] * y[N] * y[N] * y[N]
+	  + neuron.potassiumLeakConductance;
+	Scalar sodiumConductanceTotal = neuron.sodiumConductance * (y[M] * y[M] * y[M] * y[H] * (1 - neuron.blebbing)
+								    + y[BlebbedM] * y[BlebbedM] * y[BlebbedM] * y[BlebbedH] * neuron.blebbing)
+	  + neuron.sodiumLeakConductance;
+	conductance = potassiumConductanceTotal + sodiumConductanceTotal + neuron.leakConductance;
+	steadyPotential = (potassiumConductanceTotal * potassiumReversalPotential
+			   + sodiumConductanceTotal * sodiumReversalPotential
+			   + neuron.leakConductance * neuron.leakReversalPotential - pumpBaseCurrent - neuron.stimulation) / conductance;
+      }
+      Scalar potassiumReversalPotential;
+      Scalar sodiumReversalPotential;
+      Scalar pumpBaseCurrent;
+      Scalar conductance;
+      Scalar steadyPotential;
+    };
+
+    /*
+     * Advances start by step into end. With the potential frozen at
+     * driver's, the gates are linear and are advanced exactly. With the gates
+     * and concentrations frozen at driver's, the membrane is a linear RC
+     * circuit, so the potential is advanced exactly too. The concentrations
+     * take an Euler step on the currents at driver.
+     */
+    void exponentialStep(const Scalar* start, const Scalar* driver, const Scalar step, Scalar* end) {
+      rhsEvaluations++;
+      const Scalar shifted = driver[Potential] + leftShift;
+      end[N] = Jarl::rushLarsen(alphaN(driver[Potential]), betaN(driver[Potential]), start[N], step);
+      end[M] = Jarl::rushLarsen(alphaM(driver[Potential]), betaM(driver[Potential]), start[M], step);
+      end[H] = Jarl::rushLarsen(alphaH(driver[Potential]), betaH(driver[Potential]), start[H], step);
+      end[BlebbedM] = Jarl::rushLarsen(alphaM(shifted), betaM(shifted), start[BlebbedM], step);
+      end[BlebbedH] = Jarl::rushLarsen(alphaH(shifted), betaH(shifted), start[BlebbedH], step);
+
+      Membrane membrane(*this, driver);
+      const Scalar potassiumReversalPotential = membrane.potassiumReversalPotential;
+      const Scalar sodiumReversalPotential = membrane.sodiumReversalPotential;
+      const Scalar pumpBaseCurrent = membrane.pumpBaseCurrent;
+      HH_COUNT(exponentials, 1);
+      end[Potential] = membrane.steadyPotential
+	+ (start[Potential] - membrane.steadyPotential) * exp(-membrane.conductance * step / capacitance);
+
+      Scalar potassiumCurrent = getTotalPotassiumCurrent(driver[Potential], driver[N], potassiumReversalPotential, pumpBaseCurrent);
+      Scalar sodiumCurrent = getTotalSodiumCurrent(driver[Potential], driver[M], driver[H], driver[BlebbedM], driver[BlebbedH],
+						   sodiumReversalPotential, pumpBaseCurrent);
+      end[InnerPotassiumConcentration] = start[InnerPotassiumConcentration] + step * derivativeInnerConcentration(potassiumCurrent);
+      end[OuterPotassiumConcentration] = start[OuterPotassiumConcentration] + step * derivativeOuterConcentration(potassiumCurrent);
+      end[InnerSodiumConcentration] = start[InnerSodiumConcentration] + step * derivativeInnerConcentration(sodiumCurrent);
+      end[OuterSodiumConcentration] = start[OuterSodiumConcentration] + step * derivativeOuterConcentration(sodiumCurrent);
+    }
+
+    /*
+     * The noise step that follows every deterministic one of length step,
+     * in the Langevin approximation of Fox and Lu, Phys Rev E 49 (1994):
+     * every gate x of count channels moves by sqrt((alpha (1 - x) + beta x)
+     * step / count) times a standard normal deviate, at the state the
+     * deterministic step reached, and is kept within [0, 1]. The counts are
+     * the channel densities times surfaceArea, with the sodium channels
+     * shared between the blebbed and unblebbed membrane by blebbing. A gate
+     * without channels takes the deviate and count of its counterpart in the
+     * other membrane, so without blebbing or leftShift the two stay equal
+     * as the deterministic kernels expect. The deviates are Philox draws at
+     * step noiseSteps of seed and depend on nothing else. The adaptive
+     * integrators do not see the noise in their error estimates.
+     */
+    void addNoise(const Scalar step) {
+      const Scalar sodiumChannels = sodiumChannelDensity * surfaceArea;
+      const Scalar shifted = potential + leftShift;
+      Scalar* const gates[] = {&n, &m, &h, &blebbedM, &blebbedH};
+      const Scalar alphas[] = {alphaN(potential), alphaM(potential), alphaH(potential), alphaM(shifted), alphaH(shifted)};
+      const Scalar betas[] = {betaN(potential), betaM(potential), betaH(potential), betaM(shifted), betaH(shifted)};
+      Scalar counts[] = {potassiumChannelDensity * surfaceArea, sodiumChannels * (1 - blebbing), sodiumChannels * (1 - blebbing),
+			 sodiumChannels * blebbing, sodiumChannels * blebbing};
+      Scalar deviates[6];
+      for(int draw = 0;draw < 3;draw++) {
+	Philox::normals(seed, noiseSteps, 0, draw, deviates[2 * draw], deviates[2 * draw + 1]);
+      }
+      noiseSteps++;
+      for(int i = 1;i < 3;i++) {
+	if(counts[i] <= 0) {
+	  counts[i] = counts[i + 2];
+	  deviates[i] = deviates[i + 2];
+	} else if(counts[i + 2] <= 0) {
+	  counts[i + 2] = counts[i];
+	  deviates[i + 2] = deviates[i];
+	}
+      }
+      for(int i = 0;i < 5;i++) {
+	if(counts[i] > 0) {
+	  Scalar& gate = *gates[i];
+	  const Scalar variance = max<Scalar>(0, alphas[i] * (1 - gate) + betas[i] * gate) * step / counts[i];
+	  gate = min<Scalar>(1, max<Scalar>(0, gate + sqrt(variance) * deviates[i]));
+	}
+      }
+      rateValid = false;
+    }
+
+    // Rush-Larsen step made second order by driving it from a predicted midpoint.
+    Scalar rushLarsen(const Scalar step) {
+      Scalar y[Variables], middle[Variables], next[Variables];
+      getState(y);
+      exponentialStep(y, y, step / 2, middle);
+      exponentialStep(y, middle, step, next);
+      setState(next);
+      rateValid = false;
+      acceptedSteps++;
+      if(noise != Deterministic) {
+	addNoise(step);
+      }
+      return step;
+    }
+
+    // Holds the potential at potential for step, so only the gates and concentrations move.
+    void advanceChannels(const Scalar potential, const Scalar step) {
+      Scalar y[Variables], next[Variables];
+      getState(y);
+      y[Potential] = potential;
+      exponentialStep(y, y, step, next);
+      next[Potential] = potential;
+      setState(next);
+      rateValid = false;
+      acceptedSteps++;
+      if(noise != Deterministic) {
+	addNoise(step);
+      }
+    }
+
+    /*
+     * One accepted step of the Dormand-Prince 5(4) pair, no longer than
+     * maximumStep. The last stage is the derivative at the new state and is
+     * kept for the next step (FSAL). The step size follows the PI controller
+     * of Hairer, Norsett and Wanner, Solving ODEs I, II.4.
+     */
+    Scalar dormandPrince(const Scalar maximumStep) {
+      static const Scalar a21 = 1./5;
+      static const Scalar a31 = 3./40, a32 = 9./40;
+      static const Scalar a41 = 44./45, a42 = -56./15, a43 = 32./9;
+      static const Scalar a51 = 19372./6561, a52 = -25360./2187, a53 = 64448./6561, a54 = -212./729;
+      static const Scalar a61 = 9017./3168, a62 = -355./33, a63 = 46732./5247, a64 = 49./176, a65 = -5103./18656;
+      static const Scalar a71 = 35./384, a73 = 500./1113, a74 = 125./192, a75 = -2187./6784, a76 = 11./84;
+      static const Scalar e1 = 71./57600, e3 = -71./16695, e4 = 71./1920, e5 = -17253./339200, e6 = 22./525, e7 = -1./40;
+      static const Scalar beta = .04, exponent = .2 - beta * .75, safety = .9, minimumFactor = .2, maximumFactor = 10;
+
+      Scalar y[Variables], stage[Variables], next[Variables];
+      Scalar k2[Variables], k3[Variables], k4[Variables], k5[Variables], k6[Variables], k7[Variables];
+      getState(y);
+      if(!rateValid) {
+	derivative(y, rate);
+	rateValid = true;
+      }
+      const Scalar* k1 = rate;
+
+      while(true) {
+	const bool clipped = nextStep >= maximumStep;
+	const Scalar step = clipped ? maximumStep : nextStep;
+	for(int i = 0;i < Variables;i++) {
+	  stage[i] = y[i] + step * a21 * k1[i];
+	}
+	derivative(stage, k2);
+	for(int i = 0;i < Variables;i++) {
+	  stage[i] = y[i] + step * (a31 * k1[i] + a32 * k2[i]);
+	}
+	derivative(stage, k3);
+	for(int i = 0;i < Variables;i++) {
+	  stage[i] = y[i] + step * (a41 * k1[i] + a42 * k2[i] + a43 * k3[i]);
+	}
+	derivative(stage, k4);
+	for(int i = 0;i < Variables;i++) {
+	  stage[i] = y[i] + step * (a51 * k1[i] + a52 * k2[i] + a53 * k3[i] + a54 * k4[i]);
+	}
+	derivative(stage, k5);
+	for(int i = 0;i < Variables;i++) {
+	  stage[i] = y[i] + step * (a61 * k1[i] + a62 * k2[i] + a63 * k3[i] + a64 * k4[i] + a65 * k5[i]);
+	}
+	derivative(stage, k6);
+	for(int i = 0;i < Variables;i++) {
+	  next[i] = y[i] + step * (a71 * k1[i] + a73 * k3[i] + a74 * k4[i] + a75 * k5[i] + a76 * k6[i]);
+	}
+	derivative(next, k7);
+
+	Scalar error = 0;
+	for(int i = 0;i < Variables;i++) {
+	  Scalar estimate = step * (e1 * k1[i] + e3 * k3[i] + e4 * k4[i] + e5 * k5[i] + e6 * k6[i] + e7 * k7[i]);
+	  Scalar scale = absoluteTolerance[i] + relativeTolerance[i] * max<Scalar>(fabs(y[i]), fabs(next[i]));
+	  error += (estimate / scale) * (estimate / scale);
+	}
+	error = sqrt(error / Variables);
+
+	Scalar factor = pow(error, exponent);
+	if(error <= 1 && error == error) {
+	  factor = max<Scalar>(1 / maximumFactor, min<Scalar>(1 / minimumFactor, factor / pow(lastError, beta) / safety));
+	  Scalar suggested = step / factor;
+	  nextStep = clipped ? max<Scalar>(nextStep, suggested) : suggested;
+	  lastError = max<Scalar>(error, 1e-4);
+	  acceptedSteps++;
+	  setState(next, integrator != HodgkinHuxley::Multirate);
+	  for(int i = 0;i < Variables;i++) {
+	    rate[i] = k7[i];
+	  }
+	  if(noise != Deterministic) {
+	    addNoise(step);
+	  }
+	  return step;
+	}
+	rejectedSteps++;
+	if(error != error) {
+	  nextStep = step * minimumFactor;
+	} else {
+	  nextStep = step / min<Scalar>(1 / minimumFactor, factor / safety);
+	}
+      }
+    }
+
+    /*
+     * How far the linearized reversal potentials are from the exact ones at
+     * the current concentrations, at most. With x the relative change of a
+     * concentration since linearizedAt, the logarithm leaves out -x²/2 and
+     * less, so this is half the scale of the reversal potentials times the
+     * sum of both concentrations' x², taking no logarithm itself. The
+     * pump's linearization, of the same order in x, is left out of it.
+     */
+    Scalar linearizationError() const {
+      const Scalar scale = gasConstant * temperature / faradayConstant * 1000;
+      Scalar y[Variables], error = 0;
+      getState(y);
+      for(int inner = InnerPotassiumConcentration;inner <= InnerSodiumConcentration;inner += 2) {
+	const Scalar innerChange = y[inner] / linearizedAt[inner] - 1, outerChange = y[inner + 1] / linearizedAt[inner + 1] - 1;
+	error = max(error, scale / 2 * (innerChange * innerChange + outerChange * outerChange));
+      }
+      return error;
+    }
+
+    /*
+     * One Dormand-Prince micro step, no longer than maximumStep, with the
+     * reversal potentials and pump linearized around the concentrations the
+     * macro step began at, so no stage takes a logarithm. The
+     * concentrations still move with every stage's currents, under the
+     * micro step's error control. The macro step ends, and the reversal
+     * potentials and pump are linearized again, once the linearization may
+     * be macroTolerance off.
+     */
+    Scalar multirate(const Scalar maximumStep) {
+      const Scalar step = dormandPrince(maximumStep);
+      if(linearizationError() >= macroTolerance) {
+	getState(linearizedAt);
+	linearize();
+	rateValid = false;
+      }
+      return step;
     }
   };
 
   HodgkinHuxley::HodgkinHuxley(const Settings& settings) : priv(new Private(settings)) {}
 
+  // Copies are deep: the copy continues from the same state independently of the original.
+  HodgkinHuxley::HodgkinHuxley(const HodgkinHuxley& other) : priv(new Private(*other.priv)) {}
+
+  HodgkinHuxley& HodgkinHuxley::operator=(const HodgkinHuxley& other) {
+    *priv = *other.priv;
+    return *this;
+  }
+
   HodgkinHuxley::~HodgkinHuxley() {
     delete priv;
   }
 
   Scalar HodgkinHuxley::simulate(const Scalar time, const Scalar limit, const bool force) {
-    Scalar pumpBaseCurrent;
-    Scalar potassiumReversalPotential, sodiumReversalPotential;
-    Scalar potassiumCurrent, sodiumCurrent, leakCurrent, totalCurrent;
-    Scalar nK1, nK2, nK3, nK4;
-    Scalar mK1, mK2, mK3, mK4;
-    Scalar hK1, hK2, hK3, hK4;
-    Scalar blebbedNK1, blebbedNK2, blebbedNK3, blebbedNK4;
-    Scalar blebbedMK1, blebbedMK2, blebbedMK3, blebbedMK4;
-    Scalar blebbedHK1, blebbedHK2, blebbedHK3, blebbedHK4;
-    Scalar innerPotassiumConcentrationK1, innerPotassiumConcentrationK2, innerPotassiumConcentrationK3, innerPotassiumConcentrationK4;
-    Scalar outerPotassiumConcentrationK1, outerPotassiumConcentrationK2, outerPotassiumConcentrationK3, outerPotassiumConcentrationK4;
-    Scalar innerSodiumConcentrationK1, innerSodiumConcentrationK2, innerSodiumConcentrationK3, innerSodiumConcentrationK4;
-    Scalar outerSodiumConcentrationK1, outerSodiumConcentrationK2, outerSodiumConcentrationK3, outerSodiumConcentrationK4;
-    Scalar potentialK1, potentialK2, potentialK3, potentialK4;
-
-    potassiumReversalPotential = priv->calculateReversalPotential(priv->innerPotassiumConcentration,
-								  priv->outerPotassiumConcentration);
-    sodiumReversalPotential = priv->calculateReversalPotential(priv->innerSodiumConcentration, 
-							       priv->outerSodiumConcentration);
-    pumpBaseCurrent = priv->getPumpBaseCurrent(priv->outerPotassiumConcentration,
-					       priv->innerSodiumConcentration);
-    potassiumCurrent = priv->getTotalPotassiumCurrent(priv->potential, priv->n,
-						      potassiumReversalPotential, pumpBaseCurrent);
-    sodiumCurrent = priv->getTotalSodiumCurrent(priv->potential, priv->m, priv->h, priv->blebbedM, priv->blebbedH,
-						sodiumReversalPotential, pumpBaseCurrent);
-    leakCurrent = priv->getLeakCurrent(priv->potential);
-    totalCurrent = potassiumCurrent + sodiumCurrent + leakCurrent + priv->stimulation;
-    nK1 = time * derivativeN(priv->potential, priv->n);
-    mK1 = time * derivativeM(priv->potential, priv->m);
-    hK1 = time * derivativeH(priv->potential, priv->h);
-    //blebbedNK1 = time * derivativeN(priv->potential + priv->leftShift, priv->blebbedN);
-    blebbedMK1 = time * derivativeM(priv->potential + priv->leftShift, priv->blebbedM);
-    blebbedHK1 = time * derivativeH(priv->potential + priv->leftShift, priv->blebbedH);
-    innerPotassiumConcentrationK1 = time
-      * priv->derivativeInnerConcentration(potassiumCurrent);
-    outerPotassiumConcentrationK1 = time
-      * priv->derivativeOuterConcentration(potassiumCurrent);
-    innerSodiumConcentrationK1 = time
-      * priv->derivativeInnerConcentration(sodiumCurrent);
-    outerSodiumConcentrationK1 = time
-      * priv->derivativeOuterConcentration(sodiumCurrent);
-    potentialK1 = time
-      * (-totalCurrent / priv->capacitance);
-		
-    potassiumReversalPotential = priv->calculateReversalPotential(priv->innerPotassiumConcentration + innerPotassiumConcentrationK1/2,
-								  priv->outerPotassiumConcentration + outerPotassiumConcentrationK1/2);
-    sodiumReversalPotential = priv->calculateReversalPotential(priv->innerSodiumConcentration + innerSodiumConcentrationK1/2, 
-							       priv->outerSodiumConcentration + outerSodiumConcentrationK1/2);
-    pumpBaseCurrent = priv->getPumpBaseCurrent(priv->outerPotassiumConcentration + outerPotassiumConcentrationK1/2,
-					       priv->innerSodiumConcentration + innerSodiumConcentrationK1/2);
-    potassiumCurrent = priv->getTotalPotassiumCurrent(priv->potential + potentialK1/2, priv->n + nK1/2,
-						      potassiumReversalPotential, pumpBaseCurrent);
-    sodiumCurrent = priv->getTotalSodiumCurrent(priv->potential + potentialK1/2, 
-						priv->m + mK1/2, priv->h + hK1/2, 
-						priv->blebbedM + blebbedMK1/2, priv->blebbedH + blebbedHK1/2,
-						sodiumReversalPotential, pumpBaseCurrent);
-    leakCurrent = priv->getLeakCurrent(priv->potential + potentialK1/2);
-    totalCurrent = potassiumCurrent + sodiumCurrent + leakCurrent + priv->stimulation;
-    nK2 = time * derivativeN(priv->potential + potentialK1/2, priv->n + nK1/2);
-    mK2 = time * derivativeM(priv->potential + potentialK1/2, priv->m + mK1/2);
-    hK2 = time * derivativeH(priv->potential + potentialK1/2, priv->h + hK1/2);
-    //blebbedNK2 = time * derivativeN(priv->potential + priv->leftShift + potentialK1/2, priv->blebbedN + blebbedNK1/2);
-    blebbedMK2 = time * derivativeM(priv->potential + priv->leftShift + potentialK1/2, priv->blebbedM + blebbedMK1/2);
-    blebbedHK2 = time * derivativeH(priv->potential + priv->leftShift + potentialK1/2, priv->blebbedH + blebbedHK1/2);
-    innerPotassiumConcentrationK2 = time
-      * priv->derivativeInnerConcentration(potassiumCurrent);
-    outerPotassiumConcentrationK2 = time
-      * priv->derivativeOuterConcentration(potassiumCurrent);
-    innerSodiumConcentrationK2 = time
-      * priv->derivativeInnerConcentration(sodiumCurrent);
-    outerSodiumConcentrationK2 = time
-      * priv->derivativeOuterConcentration(sodiumCurrent);
-    potentialK2 = time
-      * (-totalCurrent / priv->capacitance);
-
-    potassiumReversalPotential = priv->calculateReversalPotential(priv->innerPotassiumConcentration + innerPotassiumConcentrationK2/2,
-								  priv->outerPotassiumConcentration + outerPotassiumConcentrationK2/2);
-    sodiumReversalPotential = priv->calculateReversalPotential(priv->innerSodiumConcentration + innerSodiumConcentrationK2/2, 
-							       priv->outerSodiumConcentration + outerSodiumConcentrationK2/2);
-    pumpBaseCurrent = priv->getPumpBaseCurrent(priv->outerPotassiumConcentration + outerPotassiumConcentrationK2/2,
-					       priv->innerSodiumConcentration + innerSodiumConcentrationK2/2);
-    potassiumCurrent = priv->getTotalPotassiumCurrent(priv->potential + potentialK2/2, priv->n + nK2/2,
-						      potassiumReversalPotential, pumpBaseCurrent);
-    sodiumCurrent = priv->getTotalSodiumCurrent(priv->potential + potentialK2/2, 
-						priv->m + mK2/2, priv->h + hK2/2, 
-						priv->blebbedM + blebbedMK2/2, priv->blebbedH + blebbedHK2/2,
-						sodiumReversalPotential, pumpBaseCurrent);
-    leakCurrent = priv->getLeakCurrent(priv->potential + potentialK2/2);
-    totalCurrent = potassiumCurrent + sodiumCurrent + leakCurrent + priv->stimulation;
-    nK3 = time * derivativeN(priv->potential + potentialK2/2, priv->n + nK2/2);
-    mK3 = time * derivativeM(priv->potential + potentialK2/2, priv->m + mK2/2);
-    hK3 = time * derivativeH(priv->potential + potentialK2/2, priv->h + hK2/2);
-    //blebbedNK3 = time * derivativeN(priv->potential + priv->leftShift + potentialK2/2, priv->blebbedN + blebbedNK2/2);
-    blebbedMK3 = time * derivativeM(priv->potential + priv->leftShift + potentialK2/2, priv->blebbedM + blebbedMK2/2);
-    blebbedHK3 = time * derivativeH(priv->potential + priv->leftShift + potentialK2/2, priv->blebbedH + blebbedHK2/2);
-    innerPotassiumConcentrationK3 = time
-      * priv->derivativeInnerConcentration(potassiumCurrent);
-    outerPotassiumConcentrationK3 = time
-      * priv->derivativeOuterConcentration(potassiumCurrent);
-    innerSodiumConcentrationK3 = time
-      * priv->derivativeInnerConcentration(sodiumCurrent);
-    outerSodiumConcentrationK3 = time
-      * priv->derivativeOuterConcentration(sodiumCurrent);
-    potentialK3 = time
-      * (-totalCurrent / priv->capacitance);
-		
-    potassiumReversalPotential = priv->calculateReversalPotential(priv->innerPotassiumConcentration + innerPotassiumConcentrationK3,
-								  priv->outerPotassiumConcentration + outerPotassiumConcentrationK3);
-    sodiumReversalPotential = priv->calculateReversalPotential(priv->innerSodiumConcentration + innerSodiumConcentrationK3, 
-							       priv->outerSodiumConcentration + outerSodiumConcentrationK3);
-    pumpBaseCurrent = priv->getPumpBaseCurrent(priv->outerPotassiumConcentration + outerPotassiumConcentrationK3,
-					       priv->innerSodiumConcentration + innerSodiumConcentrationK3);
-    potassiumCurrent = priv->getTotalPotassiumCurrent(priv->potential + potentialK3, priv->n + nK3,
-						      potassiumReversalPotential, pumpBaseCurrent);
-    sodiumCurrent = priv->getTotalSodiumCurrent(priv->potential + potentialK3, 
-						priv->m + mK3, priv->h + hK3, 
-						priv->blebbedM + blebbedMK3, priv->blebbedH + blebbedHK3,
-						sodiumReversalPotential, pumpBaseCurrent);
-    leakCurrent = priv->getLeakCurrent(priv->potential + potentialK3);
-    totalCurrent = potassiumCurrent + sodiumCurrent + leakCurrent + priv->stimulation;
-    nK4 = time * derivativeN(priv->potential + potentialK3, priv->n + nK3);
-    mK4 = time * derivativeM(priv->potential + potentialK3, priv->m + mK3);
-    hK4 = time * derivativeH(priv->potential + potentialK3, priv->h + hK3);
-    //blebbedNK4 = time * derivativeN(priv->potential + priv->leftShift + potentialK3, priv->blebbedN + blebbedNK3);
-    blebbedMK4 = time * derivativeM(priv->potential + priv->leftShift + potentialK3, priv->blebbedM + blebbedMK3);
-    blebbedHK4 = time * derivativeH(priv->potential + priv->leftShift + potentialK3, priv->blebbedH + blebbedHK3);
-    innerPotassiumConcentrationK4 = time
-      * priv->derivativeInnerConcentration(potassiumCurrent);
-    outerPotassiumConcentrationK4 = time
-      * priv->derivativeOuterConcentration(potassiumCurrent);
-    innerSodiumConcentrationK4 = time
-      * priv->derivativeInnerConcentration(sodiumCurrent);
-    outerSodiumConcentrationK4 = time
-      * priv->derivativeOuterConcentration(sodiumCurrent);
-    potentialK4 = time
-      * (-totalCurrent / priv->capacitance);
-
-    Scalar change = 0, nTemp, mTemp, hTemp, blebbedMTemp, blebbedHTemp, innerPotassiumConcentrationTemp, outerPotassiumConcentrationTemp,
-      innerSodiumConcentrationTemp, outerSodiumConcentrationTemp, potentialTemp;
-
-    nTemp = nK1 + nK2 + nK3 + nK4;
-    mTemp = mK1 + mK2 + mK3 + mK4;
-    hTemp = hK1 + hK2 + hK3 + hK4;
-    //Temp = blebbedNK1 + blebbedNK2 + blebbedNK3 + blebbedNK4blebbedN;
-    blebbedMTemp = blebbedMK1 + blebbedMK2 + blebbedMK3 + blebbedMK4;
-    blebbedHTemp = blebbedHK1 + blebbedHK2 + blebbedHK3 + blebbedHK4;
-    potentialTemp = potentialK1 + potentialK2 + potentialK3 + potentialK4;
-
-    change = max<Scalar>(change, fabs(nTemp/priv->n));
-    change = max<Scalar>(change, fabs(mTemp/priv->m));
-    change = max<Scalar>(change, fabs(hTemp/priv->h));
-    change = max<Scalar>(change, fabs(blebbedMTemp/priv->blebbedM));
-    change = max<Scalar>(change, fabs(blebbedHTemp/priv->blebbedH));
-    change = max<Scalar>(change, fabs(potentialTemp/priv->potential));
-    change /= 6;
-
-    if(change < limit || force) {
-      innerPotassiumConcentrationTemp = innerPotassiumConcentrationK1 + innerPotassiumConcentrationK2 + innerPotassiumConcentrationK3 + innerPotassiumConcentrationK4;
-      outerPotassiumConcentrationTemp = outerPotassiumConcentrationK1 + outerPotassiumConcentrationK2 + outerPotassiumConcentrationK3 + outerPotassiumConcentrationK4;
-      innerSodiumConcentrationTemp = innerSodiumConcentrationK1 + innerSodiumConcentrationK2 + innerSodiumConcentrationK3 + innerSodiumConcentrationK4;
-      outerSodiumConcentrationTemp = outerSodiumConcentrationK1 + outerSodiumConcentrationK2 + outerSodiumConcentrationK3 + outerSodiumConcentrationK4;
-
-      priv->n += nTemp/6;
-      priv->m += mTemp/6;
-      priv->h += hTemp/6;
-      //priv->blebbedN += (blebbedNK1 + blebbedNK2 + blebbedNK3 + blebbedNK4)/6;
-      priv->blebbedM += blebbedMTemp/6;
-      priv->blebbedH += blebbedHTemp/6;
-      priv->innerPotassiumConcentration += innerPotassiumConcentrationTemp/6;
-      priv->outerPotassiumConcentration += outerPotassiumConcentrationTemp/6;
-      priv->innerSodiumConcentration += innerSodiumConcentrationTemp/6;
-      priv->outerSodiumConcentration += outerSodiumConcentrationTemp/6;
-      priv->lastPotential = priv->potential;
-      priv->potential += potentialTemp/6;
-      priv->potassiumReversalPotential = priv->calculateReversalPotential(priv->innerPotassiumConcentration, priv->outerPotassiumConcentration);
-      priv->sodiumReversalPotential = priv->calculateReversalPotential(priv->innerSodiumConcentration, priv->outerSodiumConcentration);
-    }
-    return change;
+    return (priv->*priv->rungeKuttaKernel)(time, limit, force);
+  }
+
+  Scalar HodgkinHuxley::advance(const Scalar maximumStep) {
+    if(priv->integrator == DormandPrince) {
+      return priv->dormandPrince(maximumStep);
+    } else if(priv->integrator == RushLarsen) {
+      return priv->rushLarsen(maximumStep);
+    } else if(priv->integrator == Multirate) {
+      return priv->multirate(maximumStep);
+    }
+    simulate(maximumStep, 0, true);
+    return maximumStep;
+  }
+
+  void HodgkinHuxley::setRateTable(const RateTable* rateTable) {
+    priv->rateTable = rateTable;
+    priv->rateValid = false;
+  }
+
+  // The reversal potentials and pump start over from the concentrations, which Multirate keeps them linearized around.
+  void HodgkinHuxley::setIntegrator(const Integrator integrator) {
+    if(priv->integrator != integrator) {
+      priv->integrator = integrator;
+      priv->getState(priv->linearizedAt);
+      priv->linearize();
+      priv->rateValid = false;
+      priv->selectKernels();
+    }
+  }
+
+  void HodgkinHuxley::setPrecision(const Precision precision) {
+    priv->precision = precision;
+    priv->selectKernels();
+  }
+
+  void HodgkinHuxley::setNoise(const Noise noise, const uint64_t seed) {
+    priv->noise = noise;
+    priv->seed = seed;
+    priv->noiseSteps = 0;
+    priv->rateValid = false;
+  }
+
+  void HodgkinHuxley::setTolerance(const Variable variable, const Scalar absolute, const Scalar relative) {
+    priv->absoluteTolerance[variable] = absolute;
+    priv->relativeTolerance[variable] = relative;
+  }
+
+  void HodgkinHuxley::setTolerances(const Scalar absolute, const Scalar relative) {
+    for(int i = 0;i < Variables;i++) {
+      priv->absoluteTolerance[i] = absolute;
+      priv->relativeTolerance[i] = relative;
+    }
+  }
+
+  void HodgkinHuxley::setMacroTolerance(const Scalar tolerance) {
+    priv->macroTolerance = tolerance;
+  }
+
+  unsigned long HodgkinHuxley::getAcceptedSteps() const {
+    return priv->acceptedSteps;
+  }
+
+  unsigned long HodgkinHuxley::getRejectedSteps() const {
+    return priv->rejectedSteps;
+  }
+
+  unsigned long HodgkinHuxley::getRhsEvaluations() const {
+    return priv->rhsEvaluations;
   }
 
   void HodgkinHuxley::setStimulation(const Scalar stimulation) {
-    priv->stimulation = stimulation;
+    if(priv->stimulation != stimulation) {
+      priv->stimulation = stimulation;
+      priv->rateValid = false;
+    }
   }
 
   void HodgkinHuxley::setBlebbing(const Scalar blebbing) {
-    priv->blebbing = blebbing;
+    if(priv->blebbing != blebbing) {
+      priv->blebbing = blebbing;
+      priv->rateValid = false;
+      priv->selectKernels();
+    }
   }
 
   void HodgkinHuxley::setLeftShift(const Scalar leftShift) {
-    priv->leftShift = leftShift;
+    if(priv->leftShift != leftShift) {
+      priv->leftShift = leftShift;
+      priv->rateValid = false;
+      priv->selectKernels();
+    }
+  }
+
+  void HodgkinHuxley::getMembrane(Scalar& conductance, Scalar& steadyPotential) const {
+    Scalar y[Variables];
+    priv->getState(y);
+    Private::Membrane membrane(*priv, y);
+    conductance = membrane.conductance;
+    steadyPotential = membrane.steadyPotential;
+  }
+
+  void HodgkinHuxley::advanceChannels(const Scalar potential, const Scalar step) {
+    priv->advanceChannels(potential, step);
+  }
+
+  // y holds Variables values, in the order of Variable.
+  void HodgkinHuxley::getState(Scalar* y) const {
+    priv->getState(y);
   }
 
   bool HodgkinHuxley::isSpiked() const {
@@ -410,14 +1013,53 @@ namespace Jarl {
     return priv->potential;
   }
 
+  Scalar HodgkinHuxley::getLastPotential() const {
+    return priv->lastPotential;
+  }
+
+  Scalar HodgkinHuxley::getThreshold() const {
+    return priv->threshold;
+  }
+
+  // Multirate's are linearized, as it steps with them.
   Scalar HodgkinHuxley::getPotassiumReversalPotential() const {
+    if(priv->integrator == Multirate) {
+      Scalar y[Variables];
+      priv->getState(y);
+      return priv->linearizedReversalPotential(priv->potassiumReversalPotential, y, InnerPotassiumConcentration,
+					       OuterPotassiumConcentration);
+    }
     return priv->potassiumReversalPotential;
   }
 
   Scalar HodgkinHuxley::getSodiumReversalPotential() const {
+    if(priv->integrator == Multirate) {
+      Scalar y[Variables];
+      priv->getState(y);
+      return priv->linearizedReversalPotential(priv->sodiumReversalPotential, y, InnerSodiumConcentration,
+					       OuterSodiumConcentration);
+    }
     return priv->sodiumReversalPotential;
   }
 
+  Scalar HodgkinHuxley::getConcentration(const Variable variable) const {
+    Scalar y[Variables];
+    priv->getState(y);
+    return y[variable];
+  }
+
+  void HodgkinHuxley::setConcentration(const Variable variable, const Scalar concentration) {
+    Scalar y[Variables];
+    priv->getState(y);
+    if(y[variable] != concentration) {
+      Scalar lastPotential = priv->lastPotential;
+      y[variable] = concentration;
+      priv->setState(y);
+      priv->lastPotential = lastPotential;
+      priv->rateValid = false;
+    }
+  }
+
   string HodgkinHuxley::toString() const {
     stringstream stream;
     stream << priv->potential << "\t" << 
@@ -425,8 +1067,81 @@ namespace Jarl {
     return stream.str();
   }
 
-  ostream &operator<<(ostream &stream, HodgkinHuxley neuron) {
+  /*
+   * Snapshot layout: magic, uint32 version, uint32 count, count Scalars in
+   * the order of Private::snapshotFields, uint32 integrator, the three
+   * uint64 step counters and, from version 2, uint32 noise with the uint64
+   * seed and noisy steps. Version 3 added the Multirate fields. The rate
+   * table is not part of the snapshot.
+   */
+  void HodgkinHuxley::save(ostream& stream) const {
+    vector<Scalar*> fields = priv->snapshotFields();
+    stream.write(snapshotMagic, sizeof(snapshotMagic));
+    writeBinary(stream, snapshotVersion);
+    writeBinary(stream, (uint32_t)fields.size());
+    for(size_t i = 0;i < fields.size();i++) {
+      writeBinary(stream, *fields[i]);
+    }
+    writeBinary(stream, (uint32_t)priv->integrator);
+    writeBinary(stream, (uint64_t)priv->acceptedSteps);
+    writeBinary(stream, (uint64_t)priv->rejectedSteps);
+    writeBinary(stream, (uint64_t)priv->rhsEvaluations);
+    writeBinary(stream, (uint32_t)priv->noise);
+    writeBinary(stream, priv->seed);
+    writeBinary(stream, priv->noiseSteps);
+  }
+
+  bool HodgkinHuxley::restore(istream& stream) {
+    char magic[sizeof(snapshotMagic)];
+    uint32_t version, count, integrator, noise = Deterministic;
+    uint64_t acceptedSteps, rejectedSteps, rhsEvaluations, seed = 0, noiseSteps = 0;
+    if(!stream.read(magic, sizeof(magic)) || memcmp(magic, snapshotMagic, sizeof(magic)) != 0
+       || !readBinary(stream, version) || version > snapshotVersion || !readBinary(stream, count)) {
+      return false;
+    }
+    vector<Scalar*> fields = priv->snapshotFields();
+    // Before version 3 the five Multirate fields were not there.
+    const size_t stored = version >= 3 ? fields.size() : fields.size() - 5;
+    if(count < stored) {
+      return false;
+    }
+    vector<Scalar> values(count);
+    for(uint32_t i = 0;i < count;i++) {
+      if(!readBinary(stream, values[i])) {
+	return false;
+      }
+    }
+    if(!readBinary(stream, integrator) || !readBinary(stream, acceptedSteps)
+       || !readBinary(stream, rejectedSteps) || !readBinary(stream, rhsEvaluations)) {
+      return false;
+    }
+    if(version >= 2 && (!readBinary(stream, noise) || !readBinary(stream, seed) || !readBinary(stream, noiseSteps))) {
+      return false;
+    }
+    for(size_t i = 0;i < stored;i++) {
+      *fields[i] = values[i];
+    }
+    if(version < 3) {
+      priv->getState(priv->linearizedAt);
+    }
+    priv->integrator = (Integrator)integrator;
+    priv->acceptedSteps = acceptedSteps;
+    priv->rejectedSteps = rejectedSteps;
+    priv->rhsEvaluations = rhsEvaluations;
+    priv->noise = (Noise)noise;
+    priv->seed = seed;
+    priv->noiseSteps = noiseSteps;
+    priv->rateValid = false;
+    priv->selectKernels();
+    if(priv->integrator == Multirate) {
+      priv->linearize();
+    }
+    return true;
+  }
+
+  ostream &operator<<(ostream &stream, const HodgkinHuxley& neuron) {
     stream << neuron.priv->potential << "\t" << neuron.priv->n << "\t" << neuron.priv->m << "\t" << neuron.priv->h << "\t" << endl;
+    return stream;
   }
 }
 
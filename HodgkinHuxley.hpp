@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <string>
+#include <stdint.h>
 
 namespace Jarl {
   typedef double Scalar;
@@ -11,12 +12,36 @@ namespace Jarl {
   extern const Scalar sodiumDissociationConstant;
   extern const Scalar gasConstant;
   extern const Scalar faradayConstant;
+  // Channels per cm² of membrane, for the channel counts of the noisy gates.
+  extern const Scalar potassiumChannelDensity;
+  extern const Scalar sodiumChannelDensity;
+
+  class RateTable;
 
   class HodgkinHuxley {
   public:
+    /*
+     * Multirate takes DormandPrince steps with the reversal potentials and
+     * pump linearized in the concentrations around where the macro step
+     * began, and only takes their logarithms again when a new macro step
+     * begins, see setMacroTolerance. The reversal potentials it reports are
+     * the linearized ones.
+     */
+    enum Integrator { RungeKutta, DormandPrince, RushLarsen, Multirate };
+    // Scalar type simulate computes its steps in; the state is always kept in Scalar.
+    enum Precision { Single, Double, Extended };
+    // Langevin adds channel noise to the gates after every step, see setNoise.
+    enum Noise { Deterministic, Langevin };
+    enum Variable {
+      Potential, N, M, H, BlebbedM, BlebbedH,
+      InnerPotassiumConcentration, OuterPotassiumConcentration,
+      InnerSodiumConcentration, OuterSodiumConcentration,
+      Variables
+    };
     class Settings {
     public:
       Settings();
+      std::string toString() const;
       Scalar potential;
       Scalar capacitance;
       Scalar leakConductance;
@@ -48,17 +73,44 @@ namespace Jarl {
       Scalar stimulation;
     };
     HodgkinHuxley(const Settings& settings);
+    HodgkinHuxley(const HodgkinHuxley& other);
+    HodgkinHuxley& operator=(const HodgkinHuxley& other);
     ~HodgkinHuxley();
     Scalar simulate(const Scalar time, const Scalar limit, const bool force);
+    Scalar advance(const Scalar maximumStep);
+    void setIntegrator(const Integrator integrator);
+    void setPrecision(const Precision precision);
+    void setRateTable(const RateTable* rateTable);
+    // Restarts the noise at the first draws of seed; a copy continues with the same draws as its original.
+    void setNoise(const Noise noise, const uint64_t seed);
+    void setTolerance(const Variable variable, const Scalar absolute, const Scalar relative);
+    void setTolerances(const Scalar absolute, const Scalar relative);
+    // The bound in mV on how far Multirate's linearized reversal potentials may be from the exact ones before a new macro step.
+    void setMacroTolerance(const Scalar tolerance);
+    unsigned long getAcceptedSteps() const;
+    unsigned long getRejectedSteps() const;
+    unsigned long getRhsEvaluations() const;
     void setStimulation(const Scalar stimulation);
     void setBlebbing(const Scalar blebbing);
     void setLeftShift(const Scalar leftShift);
+    // For compartmental models: the membrane current is conductance * (potential - steadyPotential).
+    void getMembrane(Scalar& conductance, Scalar& steadyPotential) const;
+    // Sets the potential and advances the gates and concentrations by step with it held there.
+    void advanceChannels(const Scalar potential, const Scalar step);
+    void getState(Scalar* y) const;
     bool isSpiked() const;
     Scalar getPotential() const;
+    Scalar getLastPotential() const;
+    Scalar getThreshold() const;
     Scalar getPotassiumReversalPotential() const;
     Scalar getSodiumReversalPotential() const;
+    // For neurons sharing their extracellular space, one of the four concentration variables in mM.
+    Scalar getConcentration(const Variable variable) const;
+    void setConcentration(const Variable variable, const Scalar concentration);
     std::string toString() const;
-    friend std::ostream &operator<<(std::ostream &stream, HodgkinHuxley neuron);
+    void save(std::ostream& stream) const;
+    bool restore(std::istream& stream);
+    friend std::ostream &operator<<(std::ostream &stream, const HodgkinHuxley& neuron);
   private:
     class Private;
     Private* const priv;
@@ -0,0 +1,229 @@
+#include "HodgkinHuxleyApi.h"
+#include "Experiment.hpp"
+#include "Protocol.hpp"
+#include "RateRun.hpp"
+#include <algorithm>
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+
+using namespace std;
+using namespace Jarl;
+
+static ExperimentSettings apiSettings(const hh_settings& settings) {
+  ExperimentSettings experiment;
+  HodgkinHuxley::Settings& neuron = experiment.neuron;
+  neuron.potential = settings.potential;
+  neuron.capacitance = settings.capacitance;
+  neuron.leakConductance = settings.leakConductance;
+  neuron.leakReversalPotential = settings.leakReversalPotential;
+  neuron.potassiumConductance = settings.potassiumConductance;
+  neuron.potassiumReversalPotential = settings.potassiumReversalPotential;
+  neuron.sodiumConductance = settings.sodiumConductance;
+  neuron.sodiumReversalPotential = settings.sodiumReversalPotential;
+  neuron.maxPumpCurrent = settings.maxPumpCurrent;
+  neuron.innerPotassiumConcentration = settings.innerPotassiumConcentration;
+  neuron.outerPotassiumConcentration = settings.outerPotassiumConcentration;
+  neuron.innerSodiumConcentration = settings.innerSodiumConcentration;
+  neuron.outerSodiumConcentration = settings.outerSodiumConcentration;
+  neuron.surfaceArea = settings.surfaceArea;
+  neuron.innerVolume = settings.innerVolume;
+  neuron.outerVolume = settings.outerVolume;
+  neuron.temperature = settings.temperature;
+  neuron.threshold = settings.threshold;
+  neuron.potassiumLeakConductance = settings.potassiumLeakConductance;
+  neuron.sodiumLeakConductance = settings.sodiumLeakConductance;
+  neuron.blebbing = settings.blebbing;
+  neuron.leftShift = settings.leftShift;
+  neuron.stimulation = settings.stimulation;
+  // Rows go to the caller's buffer instead of RateRun::rows.
+  experiment.traceFormat = ExperimentSettings::NoTrace;
+  experiment.verbose = false;
+  return experiment;
+}
+
+// The run keeps a pointer to the settings, so a copy has to point it at its own.
+struct hh_neuron {
+  hh_neuron(const ExperimentSettings& settings) : settings(settings), run(this->settings, Protocol(), "") {
+    run.neuron.setIntegrator(settings.integrator);
+  }
+  hh_neuron(const hh_neuron& other) : settings(other.settings), run(other.run) {
+    run.settings = &settings;
+  }
+  ExperimentSettings settings;
+  RateRun run;
+private:
+  hh_neuron& operator=(const hh_neuron&);
+};
+
+struct hh_protocol {
+  Protocol protocol;
+};
+
+/*
+ * Runs neuron to the end of its protocol, stopping at every multiple of
+ * interval on the way for a trace row.
+ */
+static long runTraced(hh_neuron* neuron, const double interval, double* trace, const long capacity) {
+  RateRun& run = neuron->run;
+  const Scalar end = run.protocol.getDuration();
+  const bool traced = trace != NULL && interval > 0;
+  long rows = 0;
+  Scalar y[HodgkinHuxley::Variables];
+  // A multiple of interval within rounding of a time counts as that time, so 3 * .1 is reached at .3.
+  const Scalar slack = 1e-9 * interval;
+  int64_t sample = traced ? (int64_t)floor(run.state.currentTime / interval) : 0;
+  while(!run.isFinished()) {
+    if(!traced) {
+      run.runUntil(end);
+      break;
+    }
+    if(rows == capacity) {
+      break;
+    }
+    while(sample * interval <= run.state.currentTime + slack) {
+      sample++;
+    }
+    if(sample * interval > end + slack) {
+      run.runUntil(end);
+      break;
+    }
+    run.runUntil(min(sample * interval, end));
+    double* row = trace + rows * hh_trace_columns();
+    row[0] = run.state.currentTime;
+    run.neuron.getState(y);
+    copy(y, y + HodgkinHuxley::Variables, row + 1);
+    rows++;
+  }
+  return rows;
+}
+
+int hh_version(void) {
+  return HH_VERSION;
+}
+
+int hh_trace_columns(void) {
+  return 1 + HH_VARIABLES;
+}
+
+void hh_reference_settings(hh_settings* settings) {
+  const HodgkinHuxley::Settings reference = referenceSettings();
+  settings->potential = reference.potential;
+  settings->capacitance = reference.capacitance;
+  settings->leakConductance = reference.leakConductance;
+  settings->leakReversalPotential = reference.leakReversalPotential;
+  settings->potassiumConductance = reference.potassiumConductance;
+  settings->potassiumReversalPotential = reference.potassiumReversalPotential;
+  settings->sodiumConductance = reference.sodiumConductance;
+  settings->sodiumReversalPotential = reference.sodiumReversalPotential;
+  settings->maxPumpCurrent = reference.maxPumpCurrent;
+  settings->innerPotassiumConcentration = reference.innerPotassiumConcentration;
+  settings->outerPotassiumConcentration = reference.outerPotassiumConcentration;
+  settings->innerSodiumConcentration = reference.innerSodiumConcentration;
+  settings->outerSodiumConcentration = reference.outerSodiumConcentration;
+  settings->surfaceArea = reference.surfaceArea;
+  settings->innerVolume = reference.innerVolume;
+  settings->outerVolume = reference.outerVolume;
+  settings->temperature = reference.temperature;
+  settings->threshold = reference.threshold;
+  settings->potassiumLeakConductance = reference.potassiumLeakConductance;
+  settings->sodiumLeakConductance = reference.sodiumLeakConductance;
+  settings->blebbing = reference.blebbing;
+  settings->leftShift = reference.leftShift;
+  settings->stimulation = reference.stimulation;
+}
+
+hh_neuron* hh_create(const hh_settings* settings) {
+  return new hh_neuron(apiSettings(*settings));
+}
+
+hh_neuron* hh_copy(const hh_neuron* neuron) {
+  return new hh_neuron(*neuron);
+}
+
+void hh_destroy(hh_neuron* neuron) {
+  delete neuron;
+}
+
+int hh_set_integrator(hh_neuron* neuron, int integrator) {
+  if(integrator < HH_RUNGE_KUTTA || integrator > HH_MULTIRATE) {
+    return 0;
+  }
+  RateRun& run = neuron->run;
+  neuron->settings.integrator = (HodgkinHuxley::Integrator)integrator;
+  run.neuron.setIntegrator(neuron->settings.integrator);
+  // Runge-Kutta steps count resolutions from 0, which the other integrators do not keep up.
+  run.state.i = (int64_t)floor(run.state.currentTime / neuron->settings.resolution);
+  run.state.steps = 1;
+  return 1;
+}
+
+int hh_set_parameter(hh_neuron* neuron, int parameter, double value) {
+  HodgkinHuxley::Settings& settings = neuron->settings.neuron;
+  if(parameter == HH_BLEBBING) {
+    settings.blebbing = value;
+  } else if(parameter == HH_LEFT_SHIFT) {
+    settings.leftShift = value;
+  } else if(parameter == HH_STIMULATION) {
+    settings.stimulation = value;
+  } else {
+    return 0;
+  }
+  neuron->run.boundary = 0;
+  return 1;
+}
+
+double hh_get_time(const hh_neuron* neuron) {
+  return neuron->run.state.currentTime;
+}
+
+void hh_get_state(const hh_neuron* neuron, double* state) {
+  neuron->run.neuron.getState(state);
+}
+
+long hh_get_spikes(const hh_neuron* neuron, double* times, long capacity) {
+  const vector<Scalar>& spikes = neuron->run.analyzer.getSpikeTimes();
+  copy(spikes.begin(), spikes.begin() + min<long>(capacity, spikes.size()), times);
+  return spikes.size();
+}
+
+long hh_simulate(hh_neuron* neuron, double duration, double interval, double* trace, long capacity) {
+  neuron->run.setProtocol(Protocol(neuron->run.state.currentTime + duration), "");
+  return runTraced(neuron, interval, trace, capacity);
+}
+
+hh_protocol* hh_protocol_create(double duration) {
+  hh_protocol* protocol = new hh_protocol;
+  protocol->protocol.setDuration(duration);
+  return protocol;
+}
+
+hh_protocol* hh_protocol_load(const char* path) {
+  hh_protocol* protocol = new hh_protocol;
+  if(!protocol->protocol.load(path)) {
+    delete protocol;
+    return NULL;
+  }
+  return protocol;
+}
+
+void hh_protocol_destroy(hh_protocol* protocol) {
+  delete protocol;
+}
+
+int hh_protocol_add(hh_protocol* protocol, int parameter, double start, double end, double from, double to) {
+  if(parameter < HH_BLEBBING || parameter > HH_STIMULATION) {
+    return 0;
+  }
+  protocol->protocol.add(Protocol::Segment((Protocol::Parameter)parameter, start, end, from, to));
+  return 1;
+}
+
+double hh_protocol_duration(const hh_protocol* protocol) {
+  return protocol->protocol.getDuration();
+}
+
+long hh_run_protocol(hh_neuron* neuron, const hh_protocol* protocol, double interval, double* trace, long capacity) {
+  neuron->run.setProtocol(protocol->protocol, "");
+  return runTraced(neuron, interval, trace, capacity);
+}
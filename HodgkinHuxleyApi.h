@@ -0,0 +1,112 @@
+#ifndef HODGKIN_HUXLEY_API_H
+#define HODGKIN_HUXLEY_API_H
+
+/*
+ * C interface of libhodgkinhuxley.so, for driving simulations from other
+ * languages without going through files. Times are in ms on the neuron's
+ * own clock, which starts at 0 when it is created. Traces go into buffers
+ * the caller owns, row major with hh_trace_columns() doubles per row: the
+ * time followed by the state in the order of hh_variable. Nothing here
+ * keeps a pointer to a caller's buffer once it returns.
+ *
+ * New functions and trailing hh_settings fields may be added, but existing
+ * ones keep their meaning; hh_version() changes when they would not.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HH_API __attribute__((visibility("default")))
+
+#define HH_VERSION 1
+
+enum hh_variable {
+  HH_POTENTIAL, HH_N, HH_M, HH_H, HH_BLEBBED_M, HH_BLEBBED_H,
+  HH_INNER_POTASSIUM_CONCENTRATION, HH_OUTER_POTASSIUM_CONCENTRATION,
+  HH_INNER_SODIUM_CONCENTRATION, HH_OUTER_SODIUM_CONCENTRATION,
+  HH_VARIABLES
+};
+
+enum hh_integrator { HH_RUNGE_KUTTA, HH_DORMAND_PRINCE, HH_RUSH_LARSEN, HH_MULTIRATE };
+
+enum hh_parameter { HH_BLEBBING, HH_LEFT_SHIFT, HH_STIMULATION };
+
+/* The fields of HodgkinHuxley::Settings, in the units Settings::toString() describes. */
+typedef struct hh_settings {
+  double potential;
+  double capacitance;
+  double leakConductance;
+  double leakReversalPotential;
+  double potassiumConductance;
+  double potassiumReversalPotential;
+  double sodiumConductance;
+  double sodiumReversalPotential;
+  double maxPumpCurrent;
+  double innerPotassiumConcentration;
+  double outerPotassiumConcentration;
+  double innerSodiumConcentration;
+  double outerSodiumConcentration;
+  double surfaceArea;
+  double innerVolume;
+  double outerVolume;
+  double temperature;
+  double threshold;
+  double potassiumLeakConductance;
+  double sodiumLeakConductance;
+  double blebbing;
+  double leftShift;
+  double stimulation;
+} hh_settings;
+
+typedef struct hh_neuron hh_neuron;
+typedef struct hh_protocol hh_protocol;
+
+HH_API int hh_version(void);
+HH_API int hh_trace_columns(void);
+/* Fills settings with the neuron every experiment in Main starts from. */
+HH_API void hh_reference_settings(hh_settings* settings);
+
+HH_API hh_neuron* hh_create(const hh_settings* settings);
+HH_API hh_neuron* hh_copy(const hh_neuron* neuron);
+HH_API void hh_destroy(hh_neuron* neuron);
+/* Setters return 0 for an integrator or parameter that does not exist, 1 otherwise. */
+HH_API int hh_set_integrator(hh_neuron* neuron, int integrator);
+/* The neuron's own value of a parameter, which holds wherever no protocol segment sets it. */
+HH_API int hh_set_parameter(hh_neuron* neuron, int parameter, double value);
+HH_API double hh_get_time(const hh_neuron* neuron);
+/* Copies HH_VARIABLES values into state. */
+HH_API void hh_get_state(const hh_neuron* neuron, double* state);
+/* Copies up to capacity spike times into times and returns how many spikes there have been. */
+HH_API long hh_get_spikes(const hh_neuron* neuron, double* times, long capacity);
+
+/*
+ * Advances the neuron by duration with its own parameters, writing a row
+ * into trace at every multiple of interval it reaches, the end included,
+ * and returns the rows written. Once capacity rows are written it stops
+ * there, short of the end, so a fixed buffer can be drained and refilled by
+ * calling again with what remains of duration. trace may be NULL, or
+ * interval 0, to only simulate.
+ */
+HH_API long hh_simulate(hh_neuron* neuron, double duration, double interval, double* trace, long capacity);
+
+/* Protocols as Protocol describes them. Loading returns NULL if path does not hold one. */
+HH_API hh_protocol* hh_protocol_create(double duration);
+HH_API hh_protocol* hh_protocol_load(const char* path);
+HH_API void hh_protocol_destroy(hh_protocol* protocol);
+HH_API int hh_protocol_add(hh_protocol* protocol, int parameter, double start, double end, double from, double to);
+HH_API double hh_protocol_duration(const hh_protocol* protocol);
+
+/*
+ * Runs the neuron through protocol from its current time to the end of the
+ * protocol, tracing like hh_simulate. A fresh neuron run to the end
+ * matches protocolExperiment.
+ */
+HH_API long hh_run_protocol(hh_neuron* neuron, const hh_protocol* protocol, double interval, double* trace,
+			    long capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
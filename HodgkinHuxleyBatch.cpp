@@ -0,0 +1,367 @@
+#include "HodgkinHuxleyBatch.hpp"
+#include "MathKernels.hpp"
+#include "Philox.hpp"
+#include "RateFunctions.hpp"
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+using namespace std;
+
+namespace Jarl {
+  class HodgkinHuxleyBatch::Private {
+  public:
+    enum Variable {
+      Potential, N, M, H, BlebbedM, BlebbedH,
+      InnerPotassium, OuterPotassium, InnerSodium, OuterSodium,
+      Variables
+    };
+
+    int size;
+    Scalar capacitance;
+    Scalar leakConductance;
+    Scalar leakReversalPotential;
+    Scalar potassiumConductance;
+    Scalar sodiumConductance;
+    Scalar maxPumpCurrent;
+    Scalar potassiumLeakConductance;
+    Scalar sodiumLeakConductance;
+    Scalar threshold;
+    Scalar reversalFactor;
+    Scalar innerFactor;
+    Scalar outerFactor;
+    Scalar potassiumChannels;
+    Scalar sodiumChannels;
+    HodgkinHuxley::Noise noise;
+    uint64_t seed;
+    uint64_t noiseSteps;
+    vector<Scalar> state, stage, rate, sum;
+    vector<Scalar> lastPotential;
+    vector<Scalar> blebbing, leftShift, stimulation;
+    // Per rate, then per lane: the Rates rates at the potential and AlphaM to BetaH at the shifted one.
+    vector<Scalar> exponents, exponentials;
+    // Per lane, the potassium then the sodium concentration ratios.
+    vector<Scalar> ratios, logarithms;
+    // Per draw, then per lane: the normal deviates of a noise step.
+    vector<Scalar> deviates;
+
+    Private(const HodgkinHuxley::Settings& settings, const int size) : size(size) {
+      capacitance = settings.capacitance;
+      leakConductance = settings.leakConductance;
+      leakReversalPotential = settings.leakReversalPotential;
+      potassiumConductance = settings.potassiumConductance;
+      sodiumConductance = settings.sodiumConductance;
+      maxPumpCurrent = settings.maxPumpCurrent;
+      potassiumLeakConductance = settings.potassiumLeakConductance;
+      sodiumLeakConductance = settings.sodiumLeakConductance;
+      threshold = settings.threshold;
+      reversalFactor = -gasConstant * settings.temperature / faradayConstant * 1000;
+      innerFactor = 1e-6 * settings.surfaceArea / faradayConstant / settings.innerVolume;
+      outerFactor = 1e-6 * settings.surfaceArea / faradayConstant / settings.outerVolume;
+      potassiumChannels = potassiumChannelDensity * settings.surfaceArea;
+      sodiumChannels = sodiumChannelDensity * settings.surfaceArea;
+      noise = HodgkinHuxley::Deterministic;
+      seed = 0;
+      noiseSteps = 0;
+
+      state.resize(Variables * size);
+      stage.resize(Variables * size);
+      rate.resize(Variables * size);
+      sum.resize(Variables * size);
+      lastPotential.assign(size, settings.potential);
+      blebbing.assign(size, settings.blebbing);
+      leftShift.assign(size, settings.leftShift);
+      stimulation.assign(size, settings.stimulation);
+      exponents.resize((Rates + 4) * size);
+      exponentials.resize((Rates + 4) * size);
+      ratios.resize(2 * size);
+      logarithms.resize(2 * size);
+
+      for(int i = 0;i < size;i++) {
+	state[Potential * size + i] = settings.potential;
+	state[N * size + i] = infinityN(settings.potential);
+	state[M * size + i] = infinityM(settings.potential);
+	state[H * size + i] = infinityH(settings.potential);
+	state[BlebbedM * size + i] = infinityM(settings.potential + settings.leftShift);
+	state[BlebbedH * size + i] = infinityH(settings.potential + settings.leftShift);
+	state[InnerPotassium * size + i] = settings.innerPotassiumConcentration;
+	state[OuterPotassium * size + i] = settings.outerPotassiumConcentration;
+	state[InnerSodium * size + i] = settings.innerSodiumConcentration;
+	state[OuterSodium * size + i] = settings.outerSodiumConcentration;
+      }
+    }
+
+    Scalar* variable(vector<Scalar>& values, const Variable which) {
+      return &values[which * size];
+    }
+
+    /*
+     * Evaluates the right hand side for every lane of y into dy. The
+     * exponentials of the rates and the logarithms of the reversal
+     * potentials are taken for all lanes at once, so MathKernels gets
+     * arrays long enough to fill its vectors.
+     */
+    void derivative(vector<Scalar>& y, vector<Scalar>& dy) {
+      const Scalar* __restrict potential = variable(y, Potential);
+      const Scalar* __restrict n = variable(y, N);
+      const Scalar* __restrict m = variable(y, M);
+      const Scalar* __restrict h = variable(y, H);
+      const Scalar* __restrict blebbedM = variable(y, BlebbedM);
+      const Scalar* __restrict blebbedH = variable(y, BlebbedH);
+      const Scalar* __restrict innerPotassium = variable(y, InnerPotassium);
+      const Scalar* __restrict outerPotassium = variable(y, OuterPotassium);
+      const Scalar* __restrict innerSodium = variable(y, InnerSodium);
+      const Scalar* __restrict outerSodium = variable(y, OuterSodium);
+      Scalar* __restrict dPotential = variable(dy, Potential);
+      Scalar* __restrict dN = variable(dy, N);
+      Scalar* __restrict dM = variable(dy, M);
+      Scalar* __restrict dH = variable(dy, H);
+      Scalar* __restrict dBlebbedM = variable(dy, BlebbedM);
+      Scalar* __restrict dBlebbedH = variable(dy, BlebbedH);
+      Scalar* __restrict dInnerPotassium = variable(dy, InnerPotassium);
+      Scalar* __restrict dOuterPotassium = variable(dy, OuterPotassium);
+      Scalar* __restrict dInnerSodium = variable(dy, InnerSodium);
+      Scalar* __restrict dOuterSodium = variable(dy, OuterSodium);
+      const Scalar* __restrict laneBlebbing = &blebbing[0];
+      const Scalar* __restrict laneLeftShift = &leftShift[0];
+      const Scalar* __restrict laneStimulation = &stimulation[0];
+      Scalar* __restrict exponent = &exponents[0];
+      const Scalar* __restrict exponential = &exponentials[0];
+      Scalar* __restrict ratio = &ratios[0];
+      const Scalar* __restrict logarithm = &logarithms[0];
+
+#pragma omp simd
+      for(int i = 0;i < size;i++) {
+	Scalar v = potential[i];
+	Scalar shifted = v + laneLeftShift[i];
+	exponent[AlphaN * size + i] = rateExponent(AlphaN, v);
+	exponent[BetaN * size + i] = rateExponent(BetaN, v);
+	exponent[AlphaM * size + i] = rateExponent(AlphaM, v);
+	exponent[BetaM * size + i] = rateExponent(BetaM, v);
+	exponent[AlphaH * size + i] = rateExponent(AlphaH, v);
+	exponent[BetaH * size + i] = rateExponent(BetaH, v);
+	exponent[Rates * size + i] = rateExponent(AlphaM, shifted);
+	exponent[(Rates + 1) * size + i] = rateExponent(BetaM, shifted);
+	exponent[(Rates + 2) * size + i] = rateExponent(AlphaH, shifted);
+	exponent[(Rates + 3) * size + i] = rateExponent(BetaH, shifted);
+	ratio[i] = innerPotassium[i] / outerPotassium[i];
+	ratio[size + i] = innerSodium[i] / outerSodium[i];
+      }
+      MathKernels::exp(exponent, &exponentials[0], (Rates + 4) * size);
+      MathKernels::log(ratio, &logarithms[0], 2 * size);
+
+#pragma omp simd
+      for(int i = 0;i < size;i++) {
+	Scalar v = potential[i];
+	Scalar shifted = v + laneLeftShift[i];
+	Scalar potassiumReversalPotential = reversalFactor * logarithm[i];
+	Scalar sodiumReversalPotential = reversalFactor * logarithm[size + i];
+	Scalar potassiumTemp = 1 + potassiumDissociationConstant / outerPotassium[i];
+	Scalar sodiumTemp = 1 + sodiumDissociationConstant / innerSodium[i];
+	Scalar pumpBaseCurrent = maxPumpCurrent / (potassiumTemp * potassiumTemp * sodiumTemp * sodiumTemp * sodiumTemp);
+	Scalar n4 = n[i] * n[i] * n[i] * n[i];
+	Scalar sodiumOpen = m[i] * m[i] * m[i] * h[i] * (1 - laneBlebbing[i])
+	  + blebbedM[i] * blebbedM[i] * blebbedM[i] * blebbedH[i] * laneBlebbing[i];
+	Scalar potassiumCurrent = (potassiumConductance * n4 + potassiumLeakConductance) * (v - potassiumReversalPotential)
+	  - 2 * pumpBaseCurrent;
+	Scalar sodiumCurrent = (sodiumConductance * sodiumOpen + sodiumLeakConductance) * (v - sodiumReversalPotential)
+	  + 3 * pumpBaseCurrent;
+	Scalar leakCurrent = leakConductance * (v - leakReversalPotential);
+
+	dPotential[i] = -(potassiumCurrent + sodiumCurrent + leakCurrent + laneStimulation[i]) / capacitance;
+	dN[i] = gateDerivative(singularRate(AlphaN, v, exponential[AlphaN * size + i]),
+			       rateFromExponential(BetaN, v, exponential[BetaN * size + i]), n[i]);
+	dM[i] = gateDerivative(singularRate(AlphaM, v, exponential[AlphaM * size + i]),
+			       rateFromExponential(BetaM, v, exponential[BetaM * size + i]), m[i]);
+	dH[i] = gateDerivative(rateFromExponential(AlphaH, v, exponential[AlphaH * size + i]),
+			       rateFromExponential(BetaH, v, exponential[BetaH * size + i]), h[i]);
+	dBlebbedM[i] = gateDerivative(singularRate(AlphaM, shifted, exponential[Rates * size + i]),
+				      rateFromExponential(BetaM, shifted, exponential[(Rates + 1) * size + i]), blebbedM[i]);
+	dBlebbedH[i] = gateDerivative(rateFromExponential(AlphaH, shifted, exponential[(Rates + 2) * size + i]),
+				      rateFromExponential(BetaH, shifted, exponential[(Rates + 3) * size + i]), blebbedH[i]);
+	dInnerPotassium[i] = -innerFactor * potassiumCurrent;
+	dOuterPotassium[i] = outerFactor * potassiumCurrent;
+	dInnerSodium[i] = -innerFactor * sodiumCurrent;
+	dOuterSodium[i] = outerFactor * sodiumCurrent;
+      }
+    }
+
+    // The noise a gate of count channels takes over step; without channels there is none.
+    static Scalar gateNoise(const Scalar alpha, const Scalar beta, const Scalar gate, const Scalar count, const Scalar step,
+			    const Scalar deviate) {
+      // Selecting the variance rather than the result lets GCC take the square root without a branch.
+      const Scalar variance = max<Scalar>(0, alpha * (1 - gate) + beta * gate) * (count > 0 ? step / count : 0);
+      return sqrt(variance) * deviate;
+    }
+
+    /*
+     * The noise of HodgkinHuxley for every lane over the next step, lane i
+     * drawing from stream i, into the first five rows of deviates. It is
+     * taken at the state the step starts from, right after the first stage,
+     * whose exponentials are still there, which saves computing the rates
+     * again at the end of the step as HodgkinHuxley does. The draws are
+     * made in a loop of their own, since GCC does not vectorize a loop with
+     * both calls and branches.
+     */
+    void drawNoise(const Scalar step) {
+      const Scalar* __restrict potential = variable(state, Potential);
+      const Scalar* __restrict n = variable(state, N);
+      const Scalar* __restrict m = variable(state, M);
+      const Scalar* __restrict h = variable(state, H);
+      const Scalar* __restrict blebbedM = variable(state, BlebbedM);
+      const Scalar* __restrict blebbedH = variable(state, BlebbedH);
+      const Scalar* __restrict laneBlebbing = &blebbing[0];
+      const Scalar* __restrict laneLeftShift = &leftShift[0];
+      const Scalar* __restrict exponential = &exponentials[0];
+      Scalar* __restrict deviate = &deviates[0];
+      const uint64_t counter = noiseSteps++;
+
+#pragma omp simd
+      for(int i = 0;i < size;i++) {
+	Philox::normals(seed, counter, i, 0, deviate[i], deviate[size + i]);
+	Philox::normals(seed, counter, i, 1, deviate[2 * size + i], deviate[3 * size + i]);
+	Philox::normals(seed, counter, i, 2, deviate[4 * size + i], deviate[5 * size + i]);
+      }
+
+#pragma omp simd
+      for(int i = 0;i < size;i++) {
+	Scalar v = potential[i];
+	Scalar shifted = v + laneLeftShift[i];
+	// A membrane without sodium channels shares the draws of the other, as in HodgkinHuxley.
+	const Scalar sodium = sodiumChannels * (1 - laneBlebbing[i]), blebbedSodium = sodiumChannels * laneBlebbing[i];
+	const Scalar unblebbed = sodium > 0 ? sodium : blebbedSodium, blebbed = blebbedSodium > 0 ? blebbedSodium : sodium;
+	const Scalar first = deviate[size + i], second = deviate[2 * size + i];
+	const Scalar third = deviate[3 * size + i], fourth = deviate[4 * size + i];
+	const Scalar mDeviate = sodium > 0 ? first : third, hDeviate = sodium > 0 ? second : fourth;
+	const Scalar blebbedMDeviate = blebbedSodium > 0 ? third : first, blebbedHDeviate = blebbedSodium > 0 ? fourth : second;
+	deviate[i] = gateNoise(singularRate(AlphaN, v, exponential[AlphaN * size + i]),
+			       rateFromExponential(BetaN, v, exponential[BetaN * size + i]), n[i], potassiumChannels, step,
+			       deviate[i]);
+	deviate[size + i] = gateNoise(singularRate(AlphaM, v, exponential[AlphaM * size + i]),
+				      rateFromExponential(BetaM, v, exponential[BetaM * size + i]), m[i], unblebbed, step,
+				      mDeviate);
+	deviate[2 * size + i] = gateNoise(rateFromExponential(AlphaH, v, exponential[AlphaH * size + i]),
+					  rateFromExponential(BetaH, v, exponential[BetaH * size + i]), h[i], unblebbed, step,
+					  hDeviate);
+	deviate[3 * size + i] = gateNoise(singularRate(AlphaM, shifted, exponential[Rates * size + i]),
+					  rateFromExponential(BetaM, shifted, exponential[(Rates + 1) * size + i]), blebbedM[i],
+					  blebbed, step, blebbedMDeviate);
+	deviate[4 * size + i] = gateNoise(rateFromExponential(AlphaH, shifted, exponential[(Rates + 2) * size + i]),
+					  rateFromExponential(BetaH, shifted, exponential[(Rates + 3) * size + i]), blebbedH[i],
+					  blebbed, step, blebbedHDeviate);
+      }
+    }
+
+    // Adds the noise drawNoise drew to the gates, N to BlebbedH, keeping them within [0, 1].
+    void addNoise() {
+      const int count = (BlebbedH - N + 1) * size;
+      Scalar* __restrict gate = variable(state, N);
+      const Scalar* __restrict deviate = &deviates[0];
+#pragma omp simd
+      for(int i = 0;i < count;i++) {
+	gate[i] = min<Scalar>(1, max<Scalar>(0, gate[i] + deviate[i]));
+      }
+    }
+
+    // stage = state + scale * rate and sum += weight * rate, over every variable of every lane.
+    void accumulate(const Scalar scale, const Scalar weight) {
+      const int count = Variables * size;
+      const Scalar* __restrict y = &state[0];
+      const Scalar* __restrict dy = &rate[0];
+      Scalar* __restrict next = &stage[0];
+      Scalar* __restrict total = &sum[0];
+#pragma omp simd
+      for(int i = 0;i < count;i++) {
+	next[i] = y[i] + scale * dy[i];
+	total[i] += weight * dy[i];
+      }
+    }
+
+    void step(const Scalar time) {
+      const int count = Variables * size;
+      sum.assign(count, 0);
+
+      derivative(state, rate);
+      if(noise != HodgkinHuxley::Deterministic) {
+	drawNoise(time);
+      }
+      accumulate(time / 2, 1);
+      derivative(stage, rate);
+      accumulate(time / 2, 2);
+      derivative(stage, rate);
+      accumulate(time, 2);
+      derivative(stage, rate);
+      accumulate(0, 1);
+
+      const Scalar* __restrict potential = variable(state, Potential);
+      Scalar* __restrict last = &lastPotential[0];
+      for(int i = 0;i < size;i++) {
+	last[i] = potential[i];
+      }
+
+      Scalar* __restrict y = &state[0];
+      const Scalar* __restrict total = &sum[0];
+      const Scalar scale = time / 6;
+#pragma omp simd
+      for(int i = 0;i < count;i++) {
+	y[i] += scale * total[i];
+      }
+      if(noise != HodgkinHuxley::Deterministic) {
+	addNoise();
+      }
+    }
+  };
+
+  HodgkinHuxleyBatch::HodgkinHuxleyBatch(const HodgkinHuxley::Settings& settings, const int size) :
+    priv(new Private(settings, size)) {}
+
+  HodgkinHuxleyBatch::~HodgkinHuxleyBatch() {
+    delete priv;
+  }
+
+  int HodgkinHuxleyBatch::size() const {
+    return priv->size;
+  }
+
+  void HodgkinHuxleyBatch::simulate(const Scalar time) {
+    priv->step(time);
+  }
+
+  void HodgkinHuxleyBatch::setNoise(const HodgkinHuxley::Noise noise, const uint64_t seed) {
+    priv->deviates.resize(noise == HodgkinHuxley::Deterministic ? 0 : 6 * priv->size);
+    priv->noise = noise;
+    priv->seed = seed;
+    priv->noiseSteps = 0;
+  }
+
+  void HodgkinHuxleyBatch::setStimulation(const int lane, const Scalar stimulation) {
+    priv->stimulation[lane] = stimulation;
+  }
+
+  void HodgkinHuxleyBatch::setBlebbing(const int lane, const Scalar blebbing) {
+    priv->blebbing[lane] = blebbing;
+  }
+
+  void HodgkinHuxleyBatch::setLeftShift(const int lane, const Scalar leftShift) {
+    priv->leftShift[lane] = leftShift;
+  }
+
+  bool HodgkinHuxleyBatch::isSpiked(const int lane) const {
+    Scalar potential = priv->state[Private::Potential * priv->size + lane];
+    return potential > priv->threshold && priv->lastPotential[lane] <= priv->threshold;
+  }
+
+  Scalar HodgkinHuxleyBatch::getPotential(const int lane) const {
+    return priv->state[Private::Potential * priv->size + lane];
+  }
+
+  Scalar HodgkinHuxleyBatch::getPotassiumReversalPotential(const int lane) const {
+    return priv->reversalFactor * log(priv->state[Private::InnerPotassium * priv->size + lane]
+				      / priv->state[Private::OuterPotassium * priv->size + lane]);
+  }
+
+  Scalar HodgkinHuxleyBatch::getSodiumReversalPotential(const int lane) const {
+    return priv->reversalFactor * log(priv->state[Private::InnerSodium * priv->size + lane]
+				      / priv->state[Private::OuterSodium * priv->size + lane]);
+  }
+}
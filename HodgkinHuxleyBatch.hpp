@@ -0,0 +1,37 @@
+#ifndef HODGKIN_HUXLEY_BATCH_HPP
+#define HODGKIN_HUXLEY_BATCH_HPP
+
+#include "HodgkinHuxley.hpp"
+
+namespace Jarl {
+  /*
+   * Advances many neurons that share one set of Settings in lockstep. The
+   * state is kept as structure-of-arrays so every RK4 stage is a single loop
+   * over the lanes that the compiler can vectorize. Blebbing, leftShift and
+   * stimulation are per lane. With noise, lane i draws from stream i of
+   * the seed, so every lane has noise of its own whatever the batch size.
+   */
+  class HodgkinHuxleyBatch {
+  public:
+    HodgkinHuxleyBatch(const HodgkinHuxley::Settings& settings, const int size);
+    ~HodgkinHuxleyBatch();
+    int size() const;
+    void simulate(const Scalar time);
+    // As HodgkinHuxley::setNoise, for every lane.
+    void setNoise(const HodgkinHuxley::Noise noise, const uint64_t seed);
+    void setStimulation(const int lane, const Scalar stimulation);
+    void setBlebbing(const int lane, const Scalar blebbing);
+    void setLeftShift(const int lane, const Scalar leftShift);
+    bool isSpiked(const int lane) const;
+    Scalar getPotential(const int lane) const;
+    Scalar getPotassiumReversalPotential(const int lane) const;
+    Scalar getSodiumReversalPotential(const int lane) const;
+  private:
+    HodgkinHuxleyBatch(const HodgkinHuxleyBatch&);
+    HodgkinHuxleyBatch& operator=(const HodgkinHuxleyBatch&);
+    class Private;
+    Private* const priv;
+  };
+}
+
+#endif
@@ -0,0 +1,69 @@
+#include "Instrumentation.hpp"
+#include <chrono>
+#include <math.h>
+#include <sstream>
+
+using namespace std;
+
+namespace Jarl {
+  static double now() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  Instrumentation::Timer::Timer(double& seconds) : seconds(seconds), start(now()) {}
+
+  Instrumentation::Timer::~Timer() {
+    seconds += now() - start;
+  }
+
+  Instrumentation::Instrumentation() {
+    reset();
+  }
+
+  Instrumentation& Instrumentation::current() {
+    static thread_local Instrumentation instrumentation;
+    return instrumentation;
+  }
+
+  bool Instrumentation::isEnabled() {
+#ifdef HH_INSTRUMENT
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void Instrumentation::reset() {
+    exponentials = 0;
+    logarithms = 0;
+    for(int i = 0;i < StepSizeBins;i++) {
+      stepSizes[i] = 0;
+    }
+    integratingSeconds = 0;
+    writingSeconds = 0;
+    started = now();
+  }
+
+  void Instrumentation::recordStep(const Scalar step) {
+    // The slack keeps steps that are a power of ten up to rounding in the decade they start.
+    int bin = step > 0 ? (int)floor(log10(step) + 1e-9) - smallestStepDecade + 1 : 0;
+    stepSizes[max(0, min<int>(StepSizeBins - 1, bin))]++;
+  }
+
+  // The counters as the members of a JSON object, without the braces.
+  string Instrumentation::toJson() const {
+    stringstream json;
+    json.precision(9);
+    json << "  \"exponentials\": " << exponentials << ",\n";
+    json << "  \"logarithms\": " << logarithms << ",\n";
+    json << "  \"stepSizes\": {";
+    for(int i = 0;i < StepSizeBins;i++) {
+      json << (i == 0 ? "\"<" : ", \">=") << "1e" << smallestStepDecade + (i == 0 ? 0 : i - 1) << "\": " << stepSizes[i];
+    }
+    json << "},\n";
+    json << "  \"integratingSeconds\": " << integratingSeconds << ",\n";
+    json << "  \"writingSeconds\": " << writingSeconds << ",\n";
+    json << "  \"wallSeconds\": " << now() - started;
+    return json.str();
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef INSTRUMENTATION_HPP
+#define INSTRUMENTATION_HPP
+
+#include "HodgkinHuxley.hpp"
+#include <string>
+
+/*
+ * Hot path counters, compiled in only with -DHH_INSTRUMENT. Without it the
+ * HH_ macros expand to nothing and the hot paths are untouched. Counts go
+ * to the calling thread's Instrumentation, which a run resets when it
+ * starts and reports when it ends.
+ */
+#ifdef HH_INSTRUMENT
+#define HH_COUNT(counter, count) (Jarl::Instrumentation::current().counter += (count))
+#define HH_STEP(step) Jarl::Instrumentation::current().recordStep(step)
+#define HH_TIME(seconds) Jarl::Instrumentation::Timer instrumentationTimer(Jarl::Instrumentation::current().seconds)
+#else
+#define HH_COUNT(counter, count) ((void)0)
+#define HH_STEP(step) ((void)0)
+#define HH_TIME(seconds) ((void)0)
+#endif
+
+namespace Jarl {
+  class Instrumentation {
+  public:
+    // Accepted step lengths by decade, from below 1e-6 ms up to 100 ms and over.
+    enum { StepSizeBins = 10 };
+    static const int smallestStepDecade = -6;
+
+    // Adds the lifetime of the timer to seconds.
+    class Timer {
+    public:
+      Timer(double& seconds);
+      ~Timer();
+    private:
+      double& seconds;
+      double start;
+    };
+
+    Instrumentation();
+    static Instrumentation& current();
+    static bool isEnabled();
+    void reset();
+    void recordStep(const Scalar step);
+    std::string toJson() const;
+
+    unsigned long exponentials;
+    unsigned long logarithms;
+    unsigned long stepSizes[StepSizeBins];
+    double integratingSeconds;
+    double writingSeconds;
+  private:
+    double started;
+  };
+}
+
+#endif
@@ -1,16 +1,22 @@
 #include "HodgkinHuxley.hpp"
+#include "Experiment.hpp"
+#include "Progress.hpp"
+#include "Protocol.hpp"
+#include "RateTable.hpp"
+#include "Refinement.hpp"
+#include "Sweep.hpp"
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <sstream>
+#include <string>
+#include <stdlib.h>
 #include <time.h>
+#include <sys/stat.h>
 
 using namespace std;
 using namespace Jarl;
 
-HodgkinHuxley::Settings settings;
-Scalar resolution;
-int writeResolution, what;
 /*
 void stimulationControlExperiment() {
   HodgkinHuxley neuron(settings);
@@ -65,121 +71,153 @@ void spontaneousBlebbingExperiment() {
   output.close();
 }
 */
-void rateExperiment(Scalar blebbing, Scalar leftShift, Scalar stimulation) {
-  HodgkinHuxley neuron(settings);
-  //cout << "    " << neuron.getPotential() << endl;
-
-  stringstream nameStream;
-  nameStream << "experiments/blebbing_" << blebbing << "_left_shift_" << leftShift << "_stimulation_" << stimulation << ".tsv";
-  ofstream output(nameStream.str().c_str());
-
-  output << "time (ms)\tpotential (mV)\tpotassium reversal potential (mv)\tsodium reversal potential (mv)" << endl;
-  Scalar blebbingStart = 100, stimulationStart = 500, duration = 200500, currentTime, change;
+int main(int argc, char* argv[]) {
+  ExperimentSettings experiment;
+  experiment.neuron = referenceSettings();
+
+  // Main sweep [stimulation] [threads] runs the blebbing x leftShift grid on every core.
+  if(argc > 1 && string(argv[1]) == "sweep") {
+    Scalar stimulation = argc > 2 ? atof(argv[2]) : 0;
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+    experiment.verbose = false;
+    // Only the per run line in summary.tsv is needed for the rate maps.
+    experiment.traceFormat = ExperimentSettings::NoTrace;
+    // Most points settle within seconds; their summaries come from extrapolating the settled state.
+    experiment.earlyStop = true;
+    // Tabulated rates agree with the exact ones to 1e-10, far below the integration error.
+    RateTable rates(1e-10);
+    experiment.rateTable = &rates;
+
+    stringstream journal;
+    journal << experiment.directory << "/sweep_stimulation_" << stimulation << ".journal";
+    Sweep sweep(journal.str());
+    sweep.addGrid(0, .01, 100, 0, .4, 100, stimulation);
+    ProgressReporter progress(experiment.directory + "/status.json");
+    experiment.progress = &progress;
+    WorkStealingPool pool(threads);
+    forkedRateExperiment(experiment, sweep, pool);
+    return 0;
+  }
 
-  time_t start = time(NULL);
+  // Main refine [stimulation] [threads] maps the same grid as sweep, sampling densely only where the rate changes.
+  if(argc > 1 && string(argv[1]) == "refine") {
+    Scalar stimulation = argc > 2 ? atof(argv[2]) : 0;
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+    experiment.verbose = false;
+    experiment.traceFormat = ExperimentSettings::NoTrace;
+    experiment.earlyStop = true;
+    RateTable rates(1e-10);
+    experiment.rateTable = &rates;
+
+    stringstream name;
+    name << experiment.directory << "/refined_stimulation_" << stimulation;
+    Refinement refinement(name.str() + ".journal", 0, .01, 100, 0, .4, 100, stimulation);
+    ProgressReporter progress(experiment.directory + "/status.json");
+    experiment.progress = &progress;
+    WorkStealingPool pool(threads);
+    int runs = refinedRateExperiment(experiment, refinement, pool);
+    refinement.write(name.str() + ".tsv");
+    cout << refinement.getSampleCount() << " of 10000 points run, " << runs << " this time" << endl;
+    return 0;
+  }
 
-  int limit = duration/resolution, steps = 1, writes = 0, second = 0;
-  what = 0;
-  for (int i = 0; i < limit;) {
-    currentTime = i * resolution;
-    if (i > writeResolution*writes) {
-      writes++;
-      //cout << steps << endl;
-      output << currentTime << "\t" << neuron.getPotential() << "\t" << neuron.getPotassiumReversalPotential() << "\t" << neuron.getSodiumReversalPotential() << endl;
-    }
-    //cout << currentTime << "\t" << steps << "\t" << change << endl;
-    if(difftime(time(NULL), start) >= second) {
-      second++;
-      cout << currentTime << "\t" << steps << "\t" << change << endl;
-    }
-    //if(neuron.isSpiked() && currentTime < 300) {
-    //  cout << currentTime << endl;
-    //}
-    //if(what == 0) {
-    //  cout << neuron.toString() << endl;
-    //  what = 1;
-    //}
-    if(currentTime > blebbingStart) {
-      neuron.setBlebbing(blebbing);
-      neuron.setLeftShift(leftShift);
-      if (currentTime > stimulationStart) {
-	neuron.setStimulation(stimulation);
-      } else {
-	neuron.setStimulation(0);
-      }
-    } else {
-      neuron.setBlebbing(0);
-      neuron.setLeftShift(0);
+  /*
+   * Main shard manifest index count [threads] runs shard index of count of
+   * the points in manifest into a directory of its own, which may be on a
+   * filesystem shared with the other shards. Running it again only runs the
+   * points its journal does not have. SweepMerge joins the shards' summaries.
+   */
+  if(argc > 4 && string(argv[1]) == "shard") {
+    int index = atoi(argv[3]), count = atoi(argv[4]);
+    int threads = argc > 5 ? atoi(argv[5]) : 0;
+    if(count < 1 || index < 0 || index >= count) {
+      cerr << "shard " << argv[3] << " of " << argv[4] << " does not exist" << endl;
+      return 1;
     }
-    change = neuron.simulate(steps*resolution, 1e-3, steps == 1);
-    while(true) {
-      if(change > 1e-3) {
-	if(steps > 1) {
-	  steps /= 10;
-	  change = neuron.simulate(steps*resolution, 1e-3, steps == 1);
-	} else {
-	  i += steps;
-	  break;
-	}
-      } else if(change < 1e-4) {
-	i += steps;
-	if(steps < 100) {
-	  steps *= 10;
-	}
-	break;
-      } else {
-	i += steps;
-	break;
-      }
+    string name = argv[2];
+    name = name.substr(name.find_last_of('/') + 1);
+    stringstream directory;
+    string experiments = experiment.directory;
+    directory << experiments << "/" << name.substr(0, name.find('.')) << "_shard_" << index << "_of_" << count;
+    experiment.directory = directory.str();
+    experiment.verbose = false;
+    experiment.traceFormat = ExperimentSettings::NoTrace;
+    experiment.earlyStop = true;
+    RateTable rates(1e-10);
+    experiment.rateTable = &rates;
+
+    Sweep sweep(experiment.directory + "/sweep.journal");
+    if(!sweep.load(argv[2])) {
+      cerr << argv[2] << ": not a sweep manifest" << endl;
+      return 1;
     }
+    sweep.shard(index, count);
+    mkdir(experiments.c_str(), 0777);
+    mkdir(experiment.directory.c_str(), 0777);
+    ProgressReporter progress(experiment.directory + "/status.json");
+    experiment.progress = &progress;
+    WorkStealingPool pool(threads);
+    forkedRateExperiment(experiment, sweep, pool);
+    return 0;
   }
-  what  = 1;
-
-  cout << blebbing << " " << leftShift << " " << stimulation << " " << difftime(time(NULL), start) << endl;
-  output.close();
-}
 
-int main(int argc, char* argv[]) {
-  resolution = 1e-3;
-  writeResolution = (int)(.1/resolution);
-  what = 0;
-
-  settings = HodgkinHuxley::Settings();
-  settings.potential = -59.9;
-  settings.threshold = -15;
-  settings.capacitance = 1;
-  settings.leakConductance = .5;
-  settings.leakReversalPotential = -59.9;
-  settings.potassiumConductance = 36;
-  settings.potassiumReversalPotential = -81.3;
-  settings.sodiumConductance = 120;
-  settings.sodiumReversalPotential = 51.5;
-  settings.maxPumpCurrent = 90.9;
-  settings.potassiumLeakConductance = .1;
-  settings.sodiumLeakConductance = .25;
-  settings.innerPotassiumConcentration = 150;
-  settings.outerPotassiumConcentration = 6;
-  settings.innerSodiumConcentration = 20;
-  settings.outerSodiumConcentration = 154;
-  settings.temperature = 293.15;
-  settings.innerVolume = 3e-15;
-  settings.outerVolume = 3e-15;
-  settings.surfaceArea = 6e-8;
+  // A killed run picks up from its last checkpoint when started again.
+  experiment.checkpointInterval = 10000;
+  // The single runs below also print how far they have got every second.
+  ProgressReporter progress(experiment.directory + "/status.json", 1, experiment.verbose);
+  experiment.progress = &progress;
+
+  // Main protocol file runs the stimulus protocol in file.
+  if(argc > 2 && string(argv[1]) == "protocol") {
+    Protocol protocol;
+    if(!protocol.load(argv[2])) {
+      cerr << argv[2] << ": not a protocol" << endl;
+      return 1;
+    }
+    string name = argv[2];
+    name = name.substr(name.find_last_of('/') + 1);
+    protocolExperiment(experiment, protocol, name.substr(0, name.find('.')));
+    return 0;
+  }
 
-  /*
-  for(Scalar blebbing = 0;blebbing < 1;blebbing += .01) {
-    for(Scalar leftShift = 0;leftShift < 40;leftShift += .4) {
-      rateExperiment(blebbing, leftShift, 0);
+  // Main cable [compartments] [blebbing] [leftShift] [stimulation] runs an axon with a blebbed middle third.
+  if(argc > 1 && string(argv[1]) == "cable") {
+    int size = argc > 2 ? atoi(argv[2]) : 30;
+    Scalar blebbing = argc > 3 ? atof(argv[3]) : 1;
+    Scalar leftShift = argc > 4 ? atof(argv[4]) : 2;
+    Scalar stimulation = argc > 5 ? atof(argv[5]) : -300;
+    if(size < 1) {
+      cerr << "cable needs at least one compartment" << endl;
+      return 1;
     }
-  }*/
+    cableExperiment(experiment, size, blebbing, leftShift, stimulation);
+    return 0;
+  }
 
-  rateExperiment(1, 2, 0);
-  
-  /*
-  for(Scalar blebbing = 0;blebbing < 1;blebbing += .01) {
-    for(Scalar leftShift = 0;leftShift < 40;leftShift += .4) {
-      rateExperiment(blebbing, leftShift, -12);
+  // Main network [neurons] [pools] [diffusion] [threads] runs neurons sharing extracellular space, half of them blebbed.
+  if(argc > 1 && string(argv[1]) == "network") {
+    int size = argc > 2 ? atoi(argv[2]) : 10000;
+    int pools = argc > 3 ? atoi(argv[3]) : 100;
+    Scalar diffusion = argc > 4 ? atof(argv[4]) : .01;
+    int threads = argc > 5 ? atoi(argv[5]) : 0;
+    if(size < 1) {
+      cerr << "network needs at least one neuron" << endl;
+      return 1;
     }
+    networkExperiment(experiment, size, pools, diffusion, 1, 2, 0, threads);
+    return 0;
   }
-  */
+
+  // Main ensemble [stimulation] [seed] runs the blebbing x leftShift grid of batchRateExperiment with channel noise.
+  if(argc > 1 && string(argv[1]) == "ensemble") {
+    Scalar stimulation = argc > 2 ? atof(argv[2]) : 0;
+    experiment.noise = HodgkinHuxley::Langevin;
+    experiment.seed = argc > 3 ? strtoull(argv[3], NULL, 10) : 1;
+    batchRateExperiment(experiment, stimulation);
+    return 0;
+  }
+
+  rateExperiment(experiment, 1, 2, 0);
+
+  //batchRateExperiment(experiment, 0);
 }
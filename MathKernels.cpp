@@ -0,0 +1,115 @@
+#include "MathKernels.hpp"
+#include <iostream>
+#include <string>
+#include <math.h>
+#include <stdlib.h>
+
+using namespace std;
+
+namespace Jarl {
+  typedef void (*Kernel)(const Scalar* x, Scalar* y, const int count);
+
+  // From the instruction set units, each built on MathKernelsVector.hpp with its own flags.
+  void sse2Exp(const Scalar* x, Scalar* y, const int count);
+  void sse2Log(const Scalar* x, Scalar* y, const int count);
+  void avx2Exp(const Scalar* x, Scalar* y, const int count);
+  void avx2Log(const Scalar* x, Scalar* y, const int count);
+  void avx512Exp(const Scalar* x, Scalar* y, const int count);
+  void avx512Log(const Scalar* x, Scalar* y, const int count);
+
+  static void libmExp(const Scalar* x, Scalar* y, const int count) {
+    for(int i = 0;i < count;i++) {
+      y[i] = ::exp(x[i]);
+    }
+  }
+
+  static void libmLog(const Scalar* x, Scalar* y, const int count) {
+    for(int i = 0;i < count;i++) {
+      y[i] = ::log(x[i]);
+    }
+  }
+
+  static bool isSupported(const MathKernels::Instructions instructions) {
+    switch(instructions) {
+    case MathKernels::Libm:
+      return true;
+    case MathKernels::Sse2:
+      return __builtin_cpu_supports("sse2");
+    case MathKernels::Avx2:
+      return __builtin_cpu_supports("avx2");
+    case MathKernels::Avx512:
+      return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+  }
+
+  // The kernels in use, the widest the CPU has unless HH_MATH names others.
+  class Dispatch {
+  public:
+    Dispatch() {
+      __builtin_cpu_init();
+      const char* forced = getenv("HH_MATH");
+      if(forced) {
+	for(int i = MathKernels::Libm;i <= MathKernels::Avx512;i++) {
+	  if(string(forced) == MathKernels::name((MathKernels::Instructions)i) && set((MathKernels::Instructions)i)) {
+	    return;
+	  }
+	}
+	cerr << "HH_MATH=" << forced << " is not available here" << endl;
+      }
+      for(int i = MathKernels::Avx512;!set((MathKernels::Instructions)i);i--);
+    }
+
+    bool set(const MathKernels::Instructions instructions) {
+      static const Kernel exps[] = {libmExp, sse2Exp, avx2Exp, avx512Exp};
+      static const Kernel logs[] = {libmLog, sse2Log, avx2Log, avx512Log};
+      if(!isSupported(instructions)) {
+	return false;
+      }
+      const MathKernels::Instructions narrow = instructions == MathKernels::Avx512 ? MathKernels::Avx2 : instructions;
+      this->instructions = instructions;
+      exp = exps[instructions];
+      log = logs[instructions];
+      shortExp = exps[narrow];
+      shortLog = logs[narrow];
+      return true;
+    }
+
+    MathKernels::Instructions instructions;
+    Kernel exp;
+    Kernel log;
+    // For arrays below shortCount, where AVX-512 costs more than it gains.
+    Kernel shortExp;
+    Kernel shortLog;
+  };
+
+  static const int shortCount = 64;
+
+  static Dispatch& dispatch() {
+    static Dispatch selected;
+    return selected;
+  }
+
+  void MathKernels::exp(const Scalar* x, Scalar* y, const int count) {
+    const Dispatch& selected = dispatch();
+    (count < shortCount ? selected.shortExp : selected.exp)(x, y, count);
+  }
+
+  void MathKernels::log(const Scalar* x, Scalar* y, const int count) {
+    const Dispatch& selected = dispatch();
+    (count < shortCount ? selected.shortLog : selected.log)(x, y, count);
+  }
+
+  MathKernels::Instructions MathKernels::getInstructions() {
+    return dispatch().instructions;
+  }
+
+  bool MathKernels::setInstructions(const Instructions instructions) {
+    return dispatch().set(instructions);
+  }
+
+  const char* MathKernels::name(const Instructions instructions) {
+    static const char* names[] = {"libm", "sse2", "avx2", "avx512"};
+    return names[instructions];
+  }
+}
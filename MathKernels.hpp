@@ -0,0 +1,35 @@
+#ifndef MATH_KERNELS_HPP
+#define MATH_KERNELS_HPP
+
+#include "HodgkinHuxley.hpp"
+
+namespace Jarl {
+  /*
+   * exp and log over arrays, in the widest vector instructions the CPU
+   * has. The instructions are picked once at startup and may be forced
+   * with HH_MATH=libm, sse2, avx2 or avx512 in the environment. Every
+   * vector kernel does the same IEEE operations in the same order, so
+   * results do not depend on which one runs; that lets arrays shorter than
+   * 64 go to AVX2 even where AVX-512 is picked, since they are too short to
+   * make up for its slower clock.
+   *
+   * Both are within 1 ulp of the exact result. exp overflows to infinity
+   * above 709.78 and underflows through the subnormals to 0 below -745.13.
+   * log hands everything but positive normal doubles to libm. The bound is
+   * from 2 * 10^7 arguments per function, spread over the whole range and
+   * over the range the model uses, against long double: the largest errors
+   * seen were 0.78 ulp for exp and 0.81 ulp for log, where libm's are 0.51.
+   */
+  class MathKernels {
+  public:
+    enum Instructions { Libm, Sse2, Avx2, Avx512 };
+    static void exp(const Scalar* x, Scalar* y, const int count);
+    static void log(const Scalar* x, Scalar* y, const int count);
+    static Instructions getInstructions();
+    // False if the CPU lacks them.
+    static bool setInstructions(const Instructions instructions);
+    static const char* name(const Instructions instructions);
+  };
+}
+
+#endif
@@ -0,0 +1,11 @@
+#include "MathKernelsVector.hpp"
+
+namespace Jarl {
+  void avx2Exp(const Scalar* x, Scalar* y, const int count) {
+    vectorExp(x, y, count);
+  }
+
+  void avx2Log(const Scalar* x, Scalar* y, const int count) {
+    vectorLog(x, y, count);
+  }
+}
@@ -0,0 +1,11 @@
+#include "MathKernelsVector.hpp"
+
+namespace Jarl {
+  void avx512Exp(const Scalar* x, Scalar* y, const int count) {
+    vectorExp(x, y, count);
+  }
+
+  void avx512Log(const Scalar* x, Scalar* y, const int count) {
+    vectorLog(x, y, count);
+  }
+}
@@ -0,0 +1,11 @@
+#include "MathKernelsVector.hpp"
+
+namespace Jarl {
+  void sse2Exp(const Scalar* x, Scalar* y, const int count) {
+    vectorExp(x, y, count);
+  }
+
+  void sse2Log(const Scalar* x, Scalar* y, const int count) {
+    vectorLog(x, y, count);
+  }
+}
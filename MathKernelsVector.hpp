@@ -0,0 +1,109 @@
+#ifndef MATH_KERNELS_VECTOR_HPP
+#define MATH_KERNELS_VECTOR_HPP
+
+#include "HodgkinHuxley.hpp"
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * The loops behind MathKernels, included by one translation unit per
+ * instruction set, each compiled with its own -m flags. They are static so
+ * every unit keeps its own copy instead of the linker picking one for all.
+ * -ffp-contract=off keeps FMA from changing results between units, and
+ * -fno-trapping-math lets the clamps become blends. Only integer
+ * operations touch the bits, so no lane ever needs a conversion between
+ * doubles and 64 bit integers, which SSE2 and AVX2 lack.
+ */
+namespace Jarl {
+  namespace {
+    inline uint64_t toBits(const Scalar x) {
+      uint64_t bits;
+      memcpy(&bits, &x, sizeof(bits));
+      return bits;
+    }
+
+    inline Scalar fromBits(const uint64_t bits) {
+      Scalar x;
+      memcpy(&x, &bits, sizeof(x));
+      return x;
+    }
+
+    // Adding it to a double below 2^51 in magnitude rounds that to an integer held in the low bits.
+    const Scalar shifter = 0x1.8p52;
+
+    /*
+     * exp(x) = 2^k exp(r) with k the integer nearest x / ln 2 and r the
+     * rest, |r| <= ln 2 / 2, found with ln 2 split into a tail and a head
+     * short enough for k times it to be exact. r is kept with the error of
+     * its rounding, exp(r) - 1 - r is its Taylor polynomial to degree 13 in
+     * Estrin's scheme, and 1 + r is added exactly, which leaves a little
+     * over half an ulp. 2^k is applied as two factors so results near the
+     * ends of the range underflow and overflow in the multiplication like
+     * they should.
+     */
+    inline void vectorExp(const Scalar* __restrict x, Scalar* __restrict y, const int count) {
+      const Scalar log2e = 0x1.71547652b82fep0, ln2Head = 6.93147180369123816490e-01, ln2Tail = 1.90821492927058770002e-10;
+#pragma omp simd
+      for(int i = 0;i < count;i++) {
+	Scalar value = x[i];
+	value = value < -746 ? -746 : value;
+	value = value > 710 ? 710 : value;
+	const Scalar shifted = value * log2e + shifter;
+	const Scalar k = shifted - shifter;
+	const Scalar high = value - k * ln2Head, low = k * ln2Tail;
+	const Scalar r = high - low;
+	const Scalar rest = (high - r) - low;
+	const Scalar r2 = r * r, r4 = r2 * r2, r8 = r4 * r4;
+	const Scalar first = (1 / 2.0 + r * (1 / 6.0)) + r2 * ((1 / 24.0) + r * (1 / 120.0));
+	const Scalar second = ((1 / 720.0) + r * (1 / 5040.0)) + r2 * ((1 / 40320.0) + r * (1 / 362880.0));
+	const Scalar third = ((1 / 3628800.0) + r * (1 / 39916800.0)) + r2 * ((1 / 479001600.0) + r * (1 / 6227020800.0));
+	const Scalar sum = 1 + r;
+	const Scalar result = sum + (((1 - sum) + r) + (rest + r2 * ((first + r4 * second) + r8 * third)));
+	// k + 2048 is positive, so halving it takes a logical shift, which SSE2 and AVX2 have for 64 bits.
+	const uint64_t power = toBits(shifted) - toBits(shifter) + 2048;
+	const uint64_t half = power >> 1;
+	// A NaN stays one through the polynomial; the comparisons above only clamp numbers.
+	y[i] = result * fromBits((half - 1) << 52) * fromBits((power - half - 1) << 52);
+      }
+    }
+
+    /*
+     * log(x) = k ln 2 + log(z) with z in [sqrt(2) / 2, sqrt(2)) and log(z)
+     * = log(1 + f) from s = f / (2 + f) as in fdlibm: 2s + s R(s^2) with R
+     * its minimax polynomial. Arguments that are not positive normal
+     * doubles are handed to libm afterwards.
+     */
+    inline void vectorLog(const Scalar* __restrict x, Scalar* __restrict y, const int count) {
+      const Scalar ln2Head = 6.93147180369123816490e-01, ln2Tail = 1.90821492927058770002e-10;
+      const Scalar lg1 = 6.666666666666735130e-01, lg2 = 3.999999999940941908e-01, lg3 = 2.857142874366239149e-01,
+	lg4 = 2.222219843214978396e-01, lg5 = 1.818357216161805012e-01, lg6 = 1.531383769920937332e-01,
+	lg7 = 1.479819860511658591e-01;
+      const uint64_t offset = 0x3fe6a09e667f3bcdULL;
+#pragma omp simd
+      for(int i = 0;i < count;i++) {
+	const uint64_t bits = toBits(x[i]);
+	const uint64_t moved = bits - offset;
+	const int64_t k = (int64_t)moved >> 52;
+	const Scalar z = fromBits(bits - (moved & 0xfff0000000000000ULL));
+	const Scalar power = fromBits(toBits(shifter) + (uint64_t)k) - shifter;
+	const Scalar f = z - 1;
+	const Scalar halfSquare = .5 * f * f;
+	const Scalar s = f / (2 + f);
+	const Scalar s2 = s * s;
+	const Scalar s4 = s2 * s2;
+	const Scalar even = s4 * (lg2 + s4 * (lg4 + s4 * lg6));
+	const Scalar odd = s2 * (lg1 + s4 * (lg3 + s4 * (lg5 + s4 * lg7)));
+	y[i] = s * (halfSquare + (odd + even)) + power * ln2Tail - halfSquare + f + power * ln2Head;
+      }
+      for(int i = 0;i < count;i++) {
+	if(!(x[i] >= DBL_MIN && x[i] <= DBL_MAX)) {
+	  y[i] = ::log(x[i]);
+	}
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,230 @@
+#include "Network.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <math.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace Jarl {
+  // Blocks each of count threads in wait until all of them have arrived.
+  class Barrier {
+  public:
+    explicit Barrier(const int count) : count(count), waiting(0), generation(0) {}
+    void wait() {
+      unique_lock<mutex> lock(guard);
+      unsigned long arrived = generation;
+      if(++waiting == count) {
+	waiting = 0;
+	generation++;
+	released.notify_all();
+      } else {
+	released.wait(lock, [this, arrived] { return generation != arrived; });
+      }
+    }
+  private:
+    mutex guard;
+    condition_variable released;
+    const int count;
+    int waiting;
+    unsigned long generation;
+  };
+
+  class Network::Private {
+  public:
+    // The outer concentrations that are shared, in the order pools stores them.
+    static const int Ions = 2;
+    static const HodgkinHuxley::Variable ions[Ions];
+
+    vector<HodgkinHuxley> neurons;
+    vector<int> spikes;
+    int pools;
+    Scalar diffusion;
+    int threads;
+    // Two generations of pool concentrations, pool-major; one is read while the other is written.
+    vector<Scalar> concentrations[2];
+    int current;
+    vector<Scalar> changes;
+
+    Private(const HodgkinHuxley::Settings& settings, const int size, const int pools, const Scalar diffusion,
+	    const int threads) :
+      neurons(size, HodgkinHuxley(settings)), spikes(size, 0), pools(max(1, min(pools, size))), diffusion(diffusion),
+      threads(threads), current(0), changes(size * Ions, 0) {
+      if(this->threads <= 0) {
+	this->threads = max<int>(1, thread::hardware_concurrency());
+      }
+      this->threads = max(1, min(this->threads, size));
+      for(int i = 0;i < 2;i++) {
+	concentrations[i].resize(this->pools * Ions);
+	for(int pool = 0;pool < this->pools;pool++) {
+	  for(int ion = 0;ion < Ions;ion++) {
+	    concentrations[i][pool * Ions + ion] = neurons[0].getConcentration(ions[ion]);
+	  }
+	}
+      }
+    }
+
+    int getPool(const int neuron) const {
+      return (long)neuron * pools / neurons.size();
+    }
+
+    int getFirstNeuron(const int pool) const {
+      return ((long)pool * neurons.size() + pools - 1) / pools;
+    }
+
+    // First neuron and first pool of each thread's share are begin(thread, count).
+    int begin(const int thread, const int count) const {
+      return (long)thread * count / threads;
+    }
+
+    /*
+     * Steps the neurons of one thread through the interval and leaves the
+     * change each made to the outer concentrations in changes.
+     */
+    void advanceNeurons(const int thread, const int from, const Scalar interval, const Scalar step) {
+      const vector<Scalar>& pool = concentrations[from];
+      long steps = max<long>(1, llround(interval / step));
+      for(int i = begin(thread, neurons.size());i < begin(thread + 1, neurons.size());i++) {
+	HodgkinHuxley& neuron = neurons[i];
+	int offset = getPool(i) * Ions;
+	for(int ion = 0;ion < Ions;ion++) {
+	  neuron.setConcentration(ions[ion], pool[offset + ion]);
+	}
+	for(long j = 0;j < steps;j++) {
+	  neuron.simulate(interval / steps, 0, true);
+	  spikes[i] += neuron.isSpiked();
+	}
+	for(int ion = 0;ion < Ions;ion++) {
+	  changes[i * Ions + ion] = neuron.getConcentration(ions[ion]) - pool[offset + ion];
+	}
+      }
+    }
+
+    /*
+     * Each pool takes the mean change of its neurons, as they contribute
+     * equal volumes, and exchanges with its neighbours explicitly, which is
+     * stable while diffusion * interval stays below 1/2.
+     */
+    void exchangePools(const int thread, const int from, const Scalar interval) {
+      const vector<Scalar>& pool = concentrations[from];
+      vector<Scalar>& next = concentrations[1 - from];
+      for(int j = begin(thread, pools);j < begin(thread + 1, pools);j++) {
+	int first = getFirstNeuron(j);
+	int last = getFirstNeuron(j + 1);
+	for(int ion = 0;ion < Ions;ion++) {
+	  Scalar change = 0;
+	  for(int i = first;i < last;i++) {
+	    change += changes[i * Ions + ion];
+	  }
+	  Scalar value = pool[j * Ions + ion];
+	  Scalar flux = 0;
+	  if(j > 0) {
+	    flux += pool[(j - 1) * Ions + ion] - value;
+	  }
+	  if(j < pools - 1) {
+	    flux += pool[(j + 1) * Ions + ion] - value;
+	  }
+	  next[j * Ions + ion] = value + (last > first ? change / (last - first) : 0) + diffusion * interval * flux;
+	}
+      }
+    }
+
+    void simulate(const Scalar duration, const Scalar step, const Scalar exchange) {
+      const long intervals = max<long>(1, llround(duration / exchange));
+      const Scalar interval = duration / intervals;
+      Barrier barrier(threads);
+      // The generations alternate, so an exchange never writes what the neurons read.
+      auto work = [this, intervals, interval, step, &barrier](const int thread) {
+	for(long k = 0;k < intervals;k++) {
+	  int from = (current + k) % 2;
+	  advanceNeurons(thread, from, interval, step);
+	  barrier.wait();
+	  exchangePools(thread, from, interval);
+	  barrier.wait();
+	}
+      };
+      vector<thread> workers;
+      for(int thread = 1;thread < threads;thread++) {
+	workers.push_back(std::thread(work, thread));
+      }
+      work(0);
+      for(size_t i = 0;i < workers.size();i++) {
+	workers[i].join();
+      }
+      current = (current + intervals) % 2;
+      // Leaves every neuron with the concentrations of its pool.
+      for(size_t i = 0;i < neurons.size();i++) {
+	for(int ion = 0;ion < Ions;ion++) {
+	  neurons[i].setConcentration(ions[ion], concentrations[current][getPool(i) * Ions + ion]);
+	}
+      }
+    }
+  };
+
+  const HodgkinHuxley::Variable Network::Private::ions[Network::Private::Ions] = {
+    HodgkinHuxley::OuterPotassiumConcentration, HodgkinHuxley::OuterSodiumConcentration
+  };
+
+  Network::Network(const HodgkinHuxley::Settings& settings, const int size, const int pools, const Scalar diffusion,
+		   const int threads) :
+    priv(new Private(settings, size, pools, diffusion, threads)) {}
+
+  Network::~Network() {
+    delete priv;
+  }
+
+  int Network::size() const {
+    return priv->neurons.size();
+  }
+
+  int Network::getPools() const {
+    return priv->pools;
+  }
+
+  int Network::getPool(const int neuron) const {
+    return priv->getPool(neuron);
+  }
+
+  void Network::simulate(const Scalar duration, const Scalar step, const Scalar exchange) {
+    priv->simulate(duration, step, exchange);
+  }
+
+  void Network::setStimulation(const int neuron, const Scalar stimulation) {
+    priv->neurons[neuron].setStimulation(stimulation);
+  }
+
+  void Network::setBlebbing(const int neuron, const Scalar blebbing) {
+    priv->neurons[neuron].setBlebbing(blebbing);
+  }
+
+  void Network::setLeftShift(const int neuron, const Scalar leftShift) {
+    priv->neurons[neuron].setLeftShift(leftShift);
+  }
+
+  int Network::getSpikeCount(const int neuron) const {
+    return priv->spikes[neuron];
+  }
+
+  void Network::resetSpikeCounts() {
+    fill(priv->spikes.begin(), priv->spikes.end(), 0);
+  }
+
+  Scalar Network::getPotential(const int neuron) const {
+    return priv->neurons[neuron].getPotential();
+  }
+
+  Scalar Network::getConcentration(const int pool, const HodgkinHuxley::Variable variable) const {
+    for(int ion = 0;ion < Private::Ions;ion++) {
+      if(Private::ions[ion] == variable) {
+	return priv->concentrations[priv->current][pool * Private::Ions + ion];
+      }
+    }
+    return priv->neurons[priv->getFirstNeuron(pool)].getConcentration(variable);
+  }
+
+  const HodgkinHuxley& Network::getNeuron(const int neuron) const {
+    return priv->neurons[neuron];
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef NETWORK_HPP
+#define NETWORK_HPP
+
+#include "HodgkinHuxley.hpp"
+
+namespace Jarl {
+  /*
+   * Many neurons sharing extracellular space. The neurons are divided in
+   * order among pools, each the combined outer volume of its neurons, and
+   * neighbouring pools exchange ions by diffusion at diffusion per ms, so
+   * potassium released by one neuron depolarises the others.
+   * The neurons are stepped independently for an exchange interval, split
+   * across threads, and only meet at the pool update that follows it.
+   * size must be at least 1; pools is clamped to between 1 and size.
+   */
+  class Network {
+  public:
+    Network(const HodgkinHuxley::Settings& settings, const int size, const int pools, const Scalar diffusion,
+	    const int threads = 0);
+    ~Network();
+    int size() const;
+    int getPools() const;
+    int getPool(const int neuron) const;
+    // Advances by duration in RK4 steps of step, exchanging ions every exchange.
+    void simulate(const Scalar duration, const Scalar step, const Scalar exchange);
+    void setStimulation(const int neuron, const Scalar stimulation);
+    void setBlebbing(const int neuron, const Scalar blebbing);
+    void setLeftShift(const int neuron, const Scalar leftShift);
+    // Spikes since the last resetSpikeCounts.
+    int getSpikeCount(const int neuron) const;
+    void resetSpikeCounts();
+    Scalar getPotential(const int neuron) const;
+    // The outer concentrations are the pool's, the inner ones those of its first neuron.
+    Scalar getConcentration(const int pool, const HodgkinHuxley::Variable variable) const;
+    const HodgkinHuxley& getNeuron(const int neuron) const;
+  private:
+    Network(const Network&);
+    Network& operator=(const Network&);
+    class Private;
+    Private* const priv;
+  };
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef PHILOX_HPP
+#define PHILOX_HPP
+
+#include "HodgkinHuxley.hpp"
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace Jarl {
+  /*
+   * The Philox4x32-10 generator of Salmon, Moraes, Dror and Shaw, Parallel
+   * random numbers: as easy as 1, 2, 3 (SC11). Its numbers are a function of
+   * a 128 bit counter and a 64 bit key only, so each draw can be made on its
+   * own, in any order and on any thread, and a loop making one per lane
+   * vectorizes, which is why it is all inline. The counter here is a step,
+   * a stream and a draw within the step; the key is a seed.
+   */
+  class Philox {
+  public:
+    // The four words of the block at step, stream and draw under seed. Arrays would keep the loops from vectorizing.
+    static inline void block(const uint64_t seed, const uint64_t step, const uint32_t stream, const uint32_t draw,
+			     uint32_t& word0, uint32_t& word1, uint32_t& word2, uint32_t& word3) {
+      uint32_t c0 = (uint32_t)step, c1 = (uint32_t)(step >> 32), c2 = stream, c3 = draw;
+      uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+#pragma GCC unroll 10
+      for(int round = 0;round < 10;round++) {
+	const uint64_t first = (uint64_t)0xd2511f53 * c0, second = (uint64_t)0xcd9e8d57 * c2;
+	const uint32_t next0 = (uint32_t)(second >> 32) ^ c1 ^ k0, next2 = (uint32_t)(first >> 32) ^ c3 ^ k1;
+	c1 = (uint32_t)second;
+	c3 = (uint32_t)first;
+	c0 = next0;
+	c2 = next2;
+	k0 += 0x9e3779b9;
+	k1 += 0xbb67ae85;
+      }
+      word0 = c0;
+      word1 = c1;
+      word2 = c2;
+      word3 = c3;
+    }
+
+    /*
+     * Two independent standard normal deviates from the block at step,
+     * stream and draw, by the Box-Muller transform of its two 52 bit
+     * uniforms. The uniforms are made with integer operations only and lie
+     * strictly between 0 and 1, so the logarithm is always finite.
+     */
+    static inline void normals(const uint64_t seed, const uint64_t step, const uint32_t stream, const uint32_t draw,
+			       Scalar& first, Scalar& second) {
+      uint32_t word0, word1, word2, word3;
+      block(seed, step, stream, draw, word0, word1, word2, word3);
+      const Scalar radius = sqrt(-2 * log(uniform(word0, word1)));
+      const Scalar angle = 2 * M_PI * uniform(word2, word3);
+      // The sine as a cosine, since GCC would make the pair one sincos call, which does not vectorize.
+      first = radius * cos(angle);
+      second = radius * cos(angle - M_PI / 2);
+    }
+
+  private:
+    static inline Scalar uniform(const uint32_t high, const uint32_t low) {
+      // The 52 bits as the mantissa of a double in [2^52, 2^53), less 2^52 and centred on their interval.
+      const uint64_t bits = 0x4330000000000000ULL | ((uint64_t)high << 20) | (low >> 12);
+      Scalar value;
+      memcpy(&value, &bits, sizeof(value));
+      return (value - 0x1p52 + .5) * 0x1p-52;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,170 @@
+#include "Progress.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <stdio.h>
+#include <thread>
+
+using namespace std;
+
+namespace Jarl {
+  static double now() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  static string quoted(const string& text) {
+    string json = "\"";
+    for(size_t i = 0;i < text.size();i++) {
+      if(text[i] == '"' || text[i] == '\\') {
+	json += '\\';
+      }
+      json += text[i];
+    }
+    return json + "\"";
+  }
+
+  RunProgress::RunProgress(const string& name, const Scalar startTime, const Scalar duration) :
+    name(name), startTime(startTime), duration(duration), started(now()), time(startTime), steps(0), rejections(0),
+    step(0) {}
+
+  class ProgressReporter::Private {
+  public:
+    string path;
+    double interval;
+    bool echo;
+    double started;
+    mutex lock;
+    condition_variable wake;
+    bool stopping;
+    list<RunProgress> runs;
+    int expected;
+    int finished;
+    int startedRuns;
+    // Simulated ms of the finished runs, and of every run started, from where each started to its end.
+    Scalar finishedWork;
+    Scalar startedWork;
+    thread sampler;
+
+    Private(const string& path, const double interval, const bool echo) :
+      path(path), interval(interval), echo(echo), started(now()), stopping(false), expected(0), finished(0),
+      startedRuns(0), finishedWork(0), startedWork(0) {
+      sampler = thread(&Private::sample, this);
+    }
+
+    ~Private() {
+      {
+	lock_guard<mutex> guard(lock);
+	stopping = true;
+      }
+      wake.notify_all();
+      sampler.join();
+    }
+
+    void sample() {
+      unique_lock<mutex> guard(lock);
+      while(true) {
+	wake.wait_for(guard, chrono::duration<double>(interval), [this]() { return stopping; });
+	write();
+	if(stopping) {
+	  return;
+	}
+      }
+    }
+
+    // With lock held.
+    void write() {
+      const double time = now(), elapsed = time - started;
+      stringstream json, lines;
+      json.precision(9);
+      lines.precision(6);
+      Scalar done = finishedWork, runningLeft = 0;
+      json << "{\n  \"runs\": [";
+      for(list<RunProgress>::const_iterator run = runs.begin();run != runs.end();run++) {
+	const Scalar reached = run->time.load(memory_order_relaxed);
+	const unsigned long steps = run->steps.load(memory_order_relaxed);
+	const double seconds = time - run->started;
+	const Scalar rate = seconds > 0 ? (reached - run->startTime) / seconds : 0;
+	done += reached - run->startTime;
+	runningLeft += run->duration - reached;
+	json << (run == runs.begin() ? "\n" : ",\n") << "    {\"name\": " << quoted(run->name) << ", \"time\": " << reached
+	     << ", \"duration\": " << run->duration << ", \"steps\": " << steps
+	     << ", \"rejections\": " << run->rejections.load(memory_order_relaxed)
+	     << ", \"step\": " << run->step.load(memory_order_relaxed) << ", \"msPerSecond\": " << rate
+	     << ", \"stepsPerSecond\": " << (seconds > 0 ? steps / seconds : 0) << ", \"etaSeconds\": ";
+	if(rate > 0) {
+	  json << (run->duration - reached) / rate << "}";
+	} else {
+	  json << "null}";
+	}
+	if(echo) {
+	  lines << run->name << "\t" << reached << "\t" << run->step.load(memory_order_relaxed) << "\t" << rate << " ms/s\n";
+	}
+      }
+      const int waiting = max(0, expected - startedRuns);
+      const Scalar left = runningLeft + (startedRuns > 0 ? waiting * startedWork / startedRuns : 0);
+      const Scalar rate = elapsed > 0 ? done / elapsed : 0;
+      json << (runs.empty() ? "],\n" : "\n  ],\n");
+      json << "  \"expectedRuns\": " << max(expected, startedRuns) << ",\n";
+      json << "  \"finishedRuns\": " << finished << ",\n";
+      json << "  \"runningRuns\": " << runs.size() << ",\n";
+      json << "  \"simulatedMs\": " << done << ",\n";
+      json << "  \"msPerSecond\": " << rate << ",\n";
+      json << "  \"etaSeconds\": ";
+      if(rate > 0 && (startedRuns > 0 || waiting == 0)) {
+	json << left / rate << ",\n";
+      } else {
+	json << "null,\n";
+      }
+      json << "  \"wallSeconds\": " << elapsed << "\n}\n";
+
+      const string temporary = path + ".tmp";
+      {
+	ofstream output(temporary.c_str());
+	output << json.str();
+	if(!output) {
+	  return;
+	}
+      }
+      rename(temporary.c_str(), path.c_str());
+      if(echo && !runs.empty()) {
+	cout << lines.str() << flush;
+      }
+    }
+  };
+
+  ProgressReporter::ProgressReporter(const string& path, const double interval, const bool echo) :
+    priv(new Private(path, interval, echo)) {}
+
+  ProgressReporter::~ProgressReporter() {
+    delete priv;
+  }
+
+  void ProgressReporter::expect(const int runs) {
+    lock_guard<mutex> guard(priv->lock);
+    priv->expected += runs;
+  }
+
+  RunProgress* ProgressReporter::start(const string& name, const Scalar startTime, const Scalar duration) {
+    lock_guard<mutex> guard(priv->lock);
+    priv->runs.emplace_back(name, startTime, duration);
+    priv->startedRuns++;
+    priv->startedWork += duration - startTime;
+    return &priv->runs.back();
+  }
+
+  void ProgressReporter::finish(RunProgress* run) {
+    lock_guard<mutex> guard(priv->lock);
+    priv->finished++;
+    priv->finishedWork += run->duration - run->startTime;
+    for(list<RunProgress>::iterator i = priv->runs.begin();i != priv->runs.end();i++) {
+      if(&*i == run) {
+	priv->runs.erase(i);
+	break;
+      }
+    }
+  }
+}
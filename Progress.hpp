@@ -0,0 +1,62 @@
+#ifndef PROGRESS_HPP
+#define PROGRESS_HPP
+
+#include "HodgkinHuxley.hpp"
+#include <atomic>
+#include <string>
+
+namespace Jarl {
+  /*
+   * How far one run has got. The stepping loop only stores to it, with
+   * relaxed ordering, which costs no more than plain stores; the reporter's
+   * thread reads it whenever it samples.
+   */
+  class RunProgress {
+  public:
+    RunProgress(const std::string& name, const Scalar startTime, const Scalar duration);
+    // After every step: the time reached, the steps and rejections since the run started and the step just taken.
+    void update(const Scalar time, const unsigned long steps, const unsigned long rejections, const Scalar step) {
+      this->time.store(time, std::memory_order_relaxed);
+      this->steps.store(steps, std::memory_order_relaxed);
+      this->rejections.store(rejections, std::memory_order_relaxed);
+      this->step.store(step, std::memory_order_relaxed);
+    }
+    const std::string name;
+    const Scalar startTime;
+    const Scalar duration;
+    const double started;
+    std::atomic<Scalar> time;
+    std::atomic<unsigned long> steps;
+    std::atomic<unsigned long> rejections;
+    std::atomic<Scalar> step;
+  };
+
+  /*
+   * Samples every run started through it on a thread of its own, every
+   * interval seconds, and writes the lot as JSON to path: per run its
+   * progress, throughput since it started and estimated seconds left, and
+   * for the sweep the runs expected, finished and running, the simulated ms
+   * per second of all of them together and the estimated seconds left.
+   * The sweep's estimate takes the runs not yet started to be as long as
+   * the ones started so far. The file is replaced whole, so a reader never
+   * sees half of it. With echo, a line per running run goes to cout too.
+   */
+  class ProgressReporter {
+  public:
+    ProgressReporter(const std::string& path, const double interval = 1, const bool echo = false);
+    // Writes the status a last time.
+    ~ProgressReporter();
+    // Counts runs into the sweep's estimate before they start.
+    void expect(const int runs);
+    RunProgress* start(const std::string& name, const Scalar startTime, const Scalar duration);
+    // The run is forgotten, and must not be updated any more.
+    void finish(RunProgress* run);
+  private:
+    ProgressReporter(const ProgressReporter&);
+    ProgressReporter& operator=(const ProgressReporter&);
+    class Private;
+    Private* const priv;
+  };
+}
+
+#endif
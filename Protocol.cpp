@@ -0,0 +1,136 @@
+#include "Protocol.hpp"
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+namespace Jarl {
+  static const char* parameterNames[Protocol::Parameters] = {"blebbing", "leftShift", "stimulation"};
+
+  Protocol::Segment::Segment() : parameter(Blebbing), start(0), end(0), from(0), to(0) {}
+
+  Protocol::Segment::Segment(const Parameter parameter, const Scalar start, const Scalar end, const Scalar from,
+			     const Scalar to) :
+    parameter(parameter), start(start), end(end), from(from), to(to) {}
+
+  Protocol::Protocol(const Scalar duration) : duration(duration) {}
+
+  Protocol Protocol::standard(const Scalar blebbing, const Scalar leftShift, const Scalar stimulation) {
+    Protocol protocol(200500);
+    protocol.add(Segment(Blebbing, 0, 100, 0, 0));
+    protocol.add(Segment(LeftShift, 0, 100, 0, 0));
+    protocol.add(Segment(Blebbing, 100, protocol.duration, blebbing, blebbing));
+    protocol.add(Segment(LeftShift, 100, protocol.duration, leftShift, leftShift));
+    protocol.add(Segment(Stimulation, 100, 500, 0, 0));
+    protocol.add(Segment(Stimulation, 500, protocol.duration, stimulation, stimulation));
+    return protocol;
+  }
+
+  // Replaces the protocol with the one in path. False, leaving it unchanged, if any line does not parse.
+  bool Protocol::load(const string& path) {
+    ifstream input(path.c_str());
+    if(!input) {
+      return false;
+    }
+    Protocol loaded;
+    string line;
+    while(getline(input, line)) {
+      line = line.substr(0, line.find('#'));
+      stringstream fields(line);
+      string keyword;
+      if(!(fields >> keyword)) {
+	continue;
+      }
+      if(keyword == "duration") {
+	if(!(fields >> loaded.duration)) {
+	  return false;
+	}
+	continue;
+      }
+      int parameter = 0;
+      while(parameter < Parameters && keyword != parameterNames[parameter]) {
+	parameter++;
+      }
+      Segment segment;
+      if(parameter == Parameters || !(fields >> segment.start >> segment.end >> segment.from)
+	 || !(segment.start < segment.end)) {
+	return false;
+      }
+      segment.parameter = (Parameter)parameter;
+      if(!(fields >> segment.to)) {
+	segment.to = segment.from;
+      }
+      loaded.add(segment);
+    }
+    if(!(loaded.duration > 0)) {
+      return false;
+    }
+    *this = loaded;
+    return true;
+  }
+
+  void Protocol::add(const Segment& segment) {
+    segments.push_back(segment);
+  }
+
+  const vector<Protocol::Segment>& Protocol::getSegments() const {
+    return segments;
+  }
+
+  Scalar Protocol::getDuration() const {
+    return duration;
+  }
+
+  void Protocol::setDuration(const Scalar duration) {
+    this->duration = duration;
+  }
+
+  const Protocol::Segment* Protocol::find(const Parameter parameter, const Scalar time) const {
+    for(size_t i = segments.size();i > 0;i--) {
+      const Segment& segment = segments[i - 1];
+      if(segment.parameter == parameter && segment.start <= time && time < segment.end) {
+	return &segment;
+      }
+    }
+    return NULL;
+  }
+
+  bool Protocol::isSet(const Parameter parameter, const Scalar time) const {
+    return find(parameter, time) != NULL;
+  }
+
+  Scalar Protocol::value(const Parameter parameter, const Scalar time, const Scalar otherwise) const {
+    const Segment* segment = find(parameter, time);
+    if(!segment) {
+      return otherwise;
+    }
+    return segment->from + (segment->to - segment->from) * (time - segment->start) / (segment->end - segment->start);
+  }
+
+  bool Protocol::isRamping(const Scalar time) const {
+    for(int parameter = 0;parameter < Parameters;parameter++) {
+      const Segment* segment = find((Parameter)parameter, time);
+      if(segment && segment->from != segment->to) {
+	return true;
+      }
+    }
+    return false;
+  }
+
+  Scalar Protocol::nextBoundary(const Scalar time) const {
+    Scalar boundary = duration;
+    for(size_t i = 0;i < segments.size();i++) {
+      if(segments[i].start > time && segments[i].start < boundary) {
+	boundary = segments[i].start;
+      }
+      if(segments[i].end > time && segments[i].end < boundary) {
+	boundary = segments[i].end;
+      }
+    }
+    return boundary;
+  }
+
+  const char* Protocol::name(const Parameter parameter) {
+    return parameterNames[parameter];
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include "HodgkinHuxley.hpp"
+#include <string>
+#include <vector>
+
+namespace Jarl {
+  /*
+   * Time course of the blebbing, leftShift and stimulation parameters over
+   * an experiment, as segments on [start, end) that hold a value or ramp
+   * linearly from one value to another. Where segments of one parameter
+   * overlap the later one wins; outside every segment the parameter keeps
+   * the neuron's own setting.
+   *
+   * Protocol files hold one entry per line, # starts a comment:
+   *
+   *   duration 200500
+   *   blebbing 100 200500 1
+   *   stimulation 500 200500 0 .5      ramps from 0 to .5
+   */
+  class Protocol {
+  public:
+    enum Parameter { Blebbing, LeftShift, Stimulation, Parameters };
+
+    class Segment {
+    public:
+      Segment();
+      Segment(const Parameter parameter, const Scalar start, const Scalar end, const Scalar from, const Scalar to);
+      Parameter parameter;
+      Scalar start;
+      Scalar end;
+      Scalar from;
+      Scalar to;
+    };
+
+    Protocol(const Scalar duration = 0);
+    // The protocol rateExperiment has always run.
+    static Protocol standard(const Scalar blebbing, const Scalar leftShift, const Scalar stimulation);
+    bool load(const std::string& path);
+    void add(const Segment& segment);
+    const std::vector<Segment>& getSegments() const;
+    Scalar getDuration() const;
+    void setDuration(const Scalar duration);
+    bool isSet(const Parameter parameter, const Scalar time) const;
+    Scalar value(const Parameter parameter, const Scalar time, const Scalar otherwise = 0) const;
+    // True when some parameter is ramping at time, so it changes within the step starting there.
+    bool isRamping(const Scalar time) const;
+    // The first segment start or end after time, or the duration.
+    Scalar nextBoundary(const Scalar time) const;
+    static const char* name(const Parameter parameter);
+  private:
+    const Segment* find(const Parameter parameter, const Scalar time) const;
+    Scalar duration;
+    std::vector<Segment> segments;
+  };
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef RATE_FUNCTIONS_HPP
+#define RATE_FUNCTIONS_HPP
+
+#include "HodgkinHuxley.hpp"
+#include "Instrumentation.hpp"
+#include "MathKernels.hpp"
+#include <math.h>
+
+namespace Jarl {
+  /*
+   * Each rate is a function of the potential and one exponential of it,
+   * split so the exponentials of many can be taken at once by gateRates.
+   */
+  enum Rate { AlphaN, BetaN, AlphaM, BetaM, AlphaH, BetaH, Rates };
+
+  template<typename Real>
+  inline Real rateExponent(const Rate rate, const Real potential) {
+    switch(rate) {
+    case AlphaN:
+      return -(potential + 55) / 10;
+    case BetaN:
+      return -(potential + 65) / 80;
+    case AlphaM:
+      return -(potential + 40) / 10;
+    case BetaM:
+      return -(potential + 65) / 18;
+    case AlphaH:
+      return -(potential + 65) / 20;
+    default:
+      return -(potential + 35) / 10;
+    }
+  }
+
+  // The removable singularities of alphaN and alphaM are left to the callers.
+  template<typename Real>
+  inline Real rateFromExponential(const Rate rate, const Real potential, const Real exponential) {
+    switch(rate) {
+    case AlphaN:
+      return Real(.01) * (potential + 55) / (1 - exponential);
+    case BetaN:
+      return Real(.125) * exponential;
+    case AlphaM:
+      return Real(.1) * (potential + 40) / (1 - exponential);
+    case BetaM:
+      return 4 * exponential;
+    case AlphaH:
+      return Real(.07) * exponential;
+    default:
+      return 1 / (1 + exponential);
+    }
+  }
+
+  template<typename Real>
+  inline Real gateRate(const Rate rate, const Real potential) {
+    if(rate == AlphaN && potential == -55) {
+      return Real(.1);
+    } else if(rate == AlphaM && potential == -40) {
+      return 1;
+    }
+    HH_COUNT(exponentials, 1);
+    return rateFromExponential(rate, potential, exp(rateExponent(rate, potential)));
+  }
+
+  // Where an alpha has a removable singularity, the limit there instead of rateFromExponential.
+  inline Scalar singularRate(const Rate rate, const Scalar potential, const Scalar exponential) {
+    if(rate == AlphaN && potential == -55) {
+      return .1;
+    } else if(rate == AlphaM && potential == -40) {
+      return 1;
+    }
+    return rateFromExponential(rate, potential, exponential);
+  }
+
+  /*
+   * The Rates rates at potential, followed with Blebbed by those of m and
+   * h, AlphaM to BetaH, at blebbedPotential, with all their exponentials
+   * taken in one MathKernels call.
+   */
+  template<bool Blebbed>
+  inline void gateRates(const Scalar potential, const Scalar blebbedPotential, Scalar* rates) {
+    Scalar exponents[Rates + 4];
+    exponents[AlphaN] = rateExponent(AlphaN, potential);
+    exponents[BetaN] = rateExponent(BetaN, potential);
+    exponents[AlphaM] = rateExponent(AlphaM, potential);
+    exponents[BetaM] = rateExponent(BetaM, potential);
+    exponents[AlphaH] = rateExponent(AlphaH, potential);
+    exponents[BetaH] = rateExponent(BetaH, potential);
+    if(Blebbed) {
+      exponents[Rates] = rateExponent(AlphaM, blebbedPotential);
+      exponents[Rates + 1] = rateExponent(BetaM, blebbedPotential);
+      exponents[Rates + 2] = rateExponent(AlphaH, blebbedPotential);
+      exponents[Rates + 3] = rateExponent(BetaH, blebbedPotential);
+    }
+    HH_COUNT(exponentials, Blebbed ? Rates + 4 : Rates);
+    MathKernels::exp(exponents, rates, Blebbed ? Rates + 4 : Rates);
+    rates[AlphaN] = singularRate(AlphaN, potential, rates[AlphaN]);
+    rates[BetaN] = rateFromExponential(BetaN, potential, rates[BetaN]);
+    rates[AlphaM] = singularRate(AlphaM, potential, rates[AlphaM]);
+    rates[BetaM] = rateFromExponential(BetaM, potential, rates[BetaM]);
+    rates[AlphaH] = rateFromExponential(AlphaH, potential, rates[AlphaH]);
+    rates[BetaH] = rateFromExponential(BetaH, potential, rates[BetaH]);
+    if(Blebbed) {
+      rates[Rates] = singularRate(AlphaM, blebbedPotential, rates[Rates]);
+      rates[Rates + 1] = rateFromExponential(BetaM, blebbedPotential, rates[Rates + 1]);
+      rates[Rates + 2] = rateFromExponential(AlphaH, blebbedPotential, rates[Rates + 2]);
+      rates[Rates + 3] = rateFromExponential(BetaH, blebbedPotential, rates[Rates + 3]);
+    }
+  }
+
+  template<typename Real>
+  inline Real gateDerivative(const Real alpha, const Real beta, const Real x) {
+    return alpha * (1 - x) - beta * x;
+  }
+
+  // Templated on the scalar type for the float and long double model variants.
+  template<typename Real>
+  inline Real alphaN(const Real potential) {
+    return gateRate(AlphaN, potential);
+  }
+
+  template<typename Real>
+  inline Real betaN(const Real potential) {
+    return gateRate(BetaN, potential);
+  }
+
+  template<typename Real>
+  inline Real infinityN(const Real potential) {
+    return alphaN(potential) / (alphaN(potential) + betaN(potential));
+  }
+
+  template<typename Real>
+  inline Real derivativeN(const Real potential, const Real n) {
+    return gateDerivative(alphaN(potential), betaN(potential), n);
+  }
+
+  template<typename Real>
+  inline Real alphaM(const Real potential) {
+    return gateRate(AlphaM, potential);
+  }
+
+  template<typename Real>
+  inline Real betaM(const Real potential) {
+    return gateRate(BetaM, potential);
+  }
+
+  template<typename Real>
+  inline Real infinityM(const Real potential) {
+    return alphaM(potential) / (alphaM(potential) + betaM(potential));
+  }
+
+  template<typename Real>
+  inline Real derivativeM(const Real potential, const Real m) {
+    return gateDerivative(alphaM(potential), betaM(potential), m);
+  }
+
+  template<typename Real>
+  inline Real alphaH(const Real potential) {
+    return gateRate(AlphaH, potential);
+  }
+
+  template<typename Real>
+  inline Real betaH(const Real potential) {
+    return gateRate(BetaH, potential);
+  }
+
+  template<typename Real>
+  inline Real infinityH(const Real potential) {
+    return alphaH(potential) / (alphaH(potential) + betaH(potential));
+  }
+
+  template<typename Real>
+  inline Real derivativeH(const Real potential, const Real h) {
+    return gateDerivative(alphaH(potential), betaH(potential), h);
+  }
+
+  // Exact solution of dx/dt = alpha * (1 - x) - beta * x after time with alpha and beta held fixed.
+  inline Scalar rushLarsen(const Scalar alpha, const Scalar beta, const Scalar x, const Scalar time) {
+    Scalar infinity = alpha / (alpha + beta);
+    HH_COUNT(exponentials, 1);
+    return infinity + (x - infinity) * exp(-(alpha + beta) * time);
+  }
+}
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef RATE_RUN_HPP
+#define RATE_RUN_HPP
+
+#include "Experiment.hpp"
+#include "Instrumentation.hpp"
+#include "Protocol.hpp"
+#include "SpikeAnalyzer.hpp"
+#include "SteadyStateDetector.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+
+// The stepping loop shared by the experiments and the C API, not installed.
+namespace Jarl {
+  // Loop state of rateExperiment that lives outside the neuron.
+  class RunState {
+  public:
+    RunState() : currentTime(0), change(0), i(0), steps(1), writes(0), traceOffset(0) {}
+    Scalar currentTime;
+    Scalar change;
+    int64_t i;
+    int64_t steps;
+    int64_t writes;
+    int64_t traceOffset;
+  };
+
+  /*
+   * One experiment run part way through. The protocol's parameters are set
+   * on the neuron when a segment starts or ends and before every step of a
+   * ramp, and no step crosses a segment boundary. Trace rows collect in rows
+   * until the caller hands them to a file. Copying a RateRun forks it, and
+   * the copies continue independently from the same history.
+   */
+  class RateRun {
+  public:
+    const ExperimentSettings* settings;
+    Protocol protocol;
+    std::string name;
+    HodgkinHuxley neuron;
+    SpikeAnalyzer analyzer;
+    TraceDecimator decimator;
+    // Only fed with ExperimentSettings::earlyStop, once the protocol has no boundary left.
+    SteadyStateDetector detector;
+    RunState state;
+    std::vector<Scalar> rows;
+    // End of the protocol segments the current parameters were set for; 0 sets them again.
+    Scalar boundary;
+    bool ramping;
+
+    RateRun(const ExperimentSettings& settings, const Protocol& protocol, const std::string& name) :
+      settings(&settings), protocol(protocol), name(name), neuron(settings.neuron),
+      analyzer(neuron.getThreshold(), settings.rateWindow), decimator(4, settings.traceTolerance), detector(neuron.getThreshold()), boundary(0), ramping(false) {
+      neuron.setNoise(settings.noise, settings.seed);
+    }
+
+    bool isFinished() const {
+      return state.currentTime >= protocol.getDuration();
+    }
+
+    // Switches to another protocol that agrees with this one up to the current time.
+    void setProtocol(const Protocol& protocol, const std::string& name) {
+      this->protocol = protocol;
+      this->name = name;
+      boundary = 0;
+      detector.reset();
+    }
+
+    // Value of parameter the rate is measured under, i.e. at the start of the rate window.
+    Scalar getLabel(const Protocol::Parameter parameter) const {
+      const Scalar defaults[Protocol::Parameters] = {settings->neuron.blebbing, settings->neuron.leftShift,
+						     settings->neuron.stimulation};
+      return protocol.value(parameter, std::max<Scalar>(0, protocol.getDuration() - settings->rateWindow), defaults[parameter]);
+    }
+
+    // Steps up to time, landing on it exactly.
+    void runUntil(const Scalar time) {
+      while(!isFinished() && state.currentTime < time) {
+	step(time);
+      }
+    }
+
+    void setParameters() {
+      const Scalar currentTime = state.currentTime;
+      const HodgkinHuxley::Settings& neuronSettings = settings->neuron;
+      neuron.setBlebbing(protocol.value(Protocol::Blebbing, currentTime, neuronSettings.blebbing));
+      neuron.setLeftShift(protocol.value(Protocol::LeftShift, currentTime, neuronSettings.leftShift));
+      neuron.setStimulation(protocol.value(Protocol::Stimulation, currentTime, neuronSettings.stimulation));
+    }
+
+    // One step, ending no later than until.
+    void step(const Scalar until) {
+      Scalar& currentTime = state.currentTime;
+      const Scalar resolution = settings->resolution;
+      if(settings->traceFormat != ExperimentSettings::NoTrace && settings->traceTolerance > 0) {
+	const Scalar row[4] = {currentTime, neuron.getPotential(), neuron.getPotassiumReversalPotential(),
+			       neuron.getSodiumReversalPotential()};
+	decimator.add(row, rows);
+      } else if (settings->traceFormat != ExperimentSettings::NoTrace && currentTime > settings->writeResolution*resolution*state.writes) {
+	state.writes++;
+	rows.push_back(currentTime);
+	rows.push_back(neuron.getPotential());
+	rows.push_back(neuron.getPotassiumReversalPotential());
+	rows.push_back(neuron.getSodiumReversalPotential());
+      }
+      if(currentTime >= boundary) {
+	setParameters();
+	boundary = protocol.nextBoundary(currentTime);
+	ramping = protocol.isRamping(currentTime);
+	detector.reset();
+      } else if(ramping) {
+	setParameters();
+      }
+      const Scalar end = std::min(boundary, until);
+      Scalar lastTime = currentTime;
+      if(settings->integrator != HodgkinHuxley::RungeKutta) {
+	// Adaptive integrators pick their own step and keep their own clock.
+	Scalar taken = neuron.advance(std::min<Scalar>(settings->maximumStep, end - currentTime));
+	currentTime = taken >= end - currentTime ? end : currentTime + taken;
+      } else {
+	// The legacy stepper lives on the resolution grid and lands on the grid point nearest end.
+	Scalar& change = state.change;
+	int64_t& steps = state.steps;
+	const int64_t last = std::max<int64_t>(state.i + 1, llround(end / resolution));
+	// steps stays a power of ten; clipping to end only shortens the step taken.
+	int64_t length = std::min(steps, last - state.i);
+	change = neuron.simulate(length*resolution, 1e-3, length == 1);
+	while(change > 1e-3 && length > 1) {
+	  steps = std::max<int64_t>(steps / 10, 1);
+	  length = std::min(steps, last - state.i);
+	  change = neuron.simulate(length*resolution, 1e-3, length == 1);
+	}
+	state.i += length;
+	if(change < 1e-4 && steps < 100 && length == steps) {
+	  steps *= 10;
+	}
+	currentTime = state.i == last ? end : state.i * resolution;
+      }
+      HH_STEP(currentTime - lastTime);
+      analyzer.observe(lastTime, neuron.getLastPotential(), currentTime, neuron.getPotential());
+      // A noisy run never settles, and may leave rest at any time.
+      if(settings->earlyStop && settings->noise == HodgkinHuxley::Deterministic && boundary >= protocol.getDuration() && !ramping) {
+	detector.observe(currentTime, neuron);
+      }
+    }
+
+    bool hasSettled() const {
+      return detector.getOutcome() != SteadyStateDetector::Unsettled;
+    }
+  };
+}
+
+#endif
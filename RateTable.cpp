@@ -0,0 +1,85 @@
+#include "RateTable.hpp"
+#include <algorithm>
+
+using namespace std;
+
+namespace Jarl {
+  // x / (1 - exp(-x)) without the cancellation around its removable singularity at 0.
+  static Scalar linearExponential(const Scalar x) {
+    if(x == 0) {
+      return 1;
+    }
+    HH_COUNT(exponentials, 1);
+    return x / -expm1(-x);
+  }
+
+  Scalar RateTable::exact(const Rate rate, const Scalar potential) {
+    Scalar exponent = rateExponent(rate, potential);
+    switch(rate) {
+    case AlphaN:
+      return .1 * linearExponential(-exponent);
+    case AlphaM:
+      return linearExponential(-exponent);
+    default:
+      HH_COUNT(exponentials, 1);
+      return rateFromExponential(rate, potential, exp(exponent));
+    }
+  }
+
+  RateTable::RateTable(const Scalar error, const Interpolation interpolation,
+		       const Scalar minimum, const Scalar maximum) :
+    interpolation(interpolation), minimum(minimum), maximum(maximum) {
+    int nodes = 65;
+    build(nodes);
+    while(this->error > error && nodes < (1 << 22)) {
+      nodes = 2 * nodes - 1;
+      build(nodes);
+    }
+  }
+
+  Scalar RateTable::getSpacing() const {
+    return spacing;
+  }
+
+  int RateTable::getSize() const {
+    return size;
+  }
+
+  Scalar RateTable::getError() const {
+    return error;
+  }
+
+  void RateTable::build(const int size) {
+    this->size = size;
+    spacing = (maximum - minimum) / (size - 1);
+    inverseSpacing = 1 / spacing;
+    values.resize(size * Rates * 2);
+    const Scalar delta = 1e-4;
+    for(int i = 0;i < size;i++) {
+      Scalar potential = minimum + i * spacing;
+      for(int rate = 0;rate < Rates;rate++) {
+	Scalar* node = &values[(i * Rates + rate) * 2];
+	node[0] = exact((Rate)rate, potential);
+	Scalar slope = (exact((Rate)rate, potential + delta) - exact((Rate)rate, potential - delta)) / (2 * delta);
+	node[1] = slope * spacing;
+      }
+    }
+    error = measureError();
+  }
+
+  // Largest relative error at a few points inside every interval.
+  Scalar RateTable::measureError() const {
+    Scalar worst = 0;
+    for(int i = 0;i < size - 1;i++) {
+      for(int j = 1;j < 4;j++) {
+	Scalar potential = minimum + (i + j / 4.) * spacing;
+	for(int rate = 0;rate < Rates;rate++) {
+	  Scalar expected = exact((Rate)rate, potential);
+	  Scalar actual = lookup((Rate)rate, potential);
+	  worst = max<Scalar>(worst, fabs(actual - expected) / max<Scalar>(fabs(expected), 1e-12));
+	}
+      }
+    }
+    return worst;
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef RATE_TABLE_HPP
+#define RATE_TABLE_HPP
+
+#include "HodgkinHuxley.hpp"
+#include "RateFunctions.hpp"
+#include <math.h>
+#include <vector>
+
+namespace Jarl {
+  /*
+   * The alpha/beta rate functions tabulated on a uniform voltage grid. The
+   * spacing is halved until the interpolated rates stay within the requested
+   * relative error everywhere on the grid. Left-shifted channels look up
+   * potential + leftShift in the same table. Potentials outside the table
+   * fall back to the exact functions.
+   *
+   * Lookups are inline and the table is never modified after construction,
+   * so one table can be shared by any number of neurons and threads.
+   */
+  class RateTable {
+  public:
+    enum Interpolation { Linear, Cubic };
+
+    RateTable(const Scalar error, const Interpolation interpolation = Cubic,
+	      const Scalar minimum = -200, const Scalar maximum = 200);
+    Scalar getSpacing() const;
+    int getSize() const;
+    Scalar getError() const;
+
+    static Scalar exact(const Rate rate, const Scalar potential);
+
+    Scalar lookup(const Rate rate, const Scalar potential) const {
+      Scalar position = (potential - minimum) * inverseSpacing;
+      if(!(position >= 0 && position < size - 1)) {
+	return exact(rate, potential);
+      }
+      int index = (int)position;
+      Scalar t = position - index;
+      const Scalar* node = &values[(index * Rates + rate) * 2];
+      const Scalar* next = node + Rates * 2;
+      if(interpolation == Linear) {
+	return node[0] + t * (next[0] - node[0]);
+      }
+      // Cubic Hermite on values and spacing-scaled slopes.
+      Scalar t2 = t * t, t3 = t2 * t;
+      return (2 * t3 - 3 * t2 + 1) * node[0] + (t3 - 2 * t2 + t) * node[1]
+	+ (-2 * t3 + 3 * t2) * next[0] + (t3 - t2) * next[1];
+    }
+
+    Scalar alphaN(const Scalar potential) const { return lookup(AlphaN, potential); }
+    Scalar betaN(const Scalar potential) const { return lookup(BetaN, potential); }
+    Scalar alphaM(const Scalar potential) const { return lookup(AlphaM, potential); }
+    Scalar betaM(const Scalar potential) const { return lookup(BetaM, potential); }
+    Scalar alphaH(const Scalar potential) const { return lookup(AlphaH, potential); }
+    Scalar betaH(const Scalar potential) const { return lookup(BetaH, potential); }
+
+  private:
+    void build(const int size);
+    Scalar measureError() const;
+
+    Interpolation interpolation;
+    Scalar minimum;
+    Scalar maximum;
+    Scalar spacing;
+    Scalar inverseSpacing;
+    int size;
+    Scalar error;
+    // Node major: for every node, value and scaled slope of each Rate.
+    std::vector<Scalar> values;
+  };
+}
+
+#endif
@@ -0,0 +1,245 @@
+#include "Refinement.hpp"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <math.h>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+using namespace std;
+
+namespace Jarl {
+  Refinement::Sample::Sample() : rate(0), regime(SpikeAnalyzer::Quiescent) {}
+
+  Refinement::Sample::Sample(const Scalar rate, const SpikeAnalyzer::Regime regime) : rate(rate), regime(regime) {}
+
+  class Refinement::Private {
+  public:
+    // Grid indices of the corners, i along blebbing and j along leftShift.
+    class Cell {
+    public:
+      Cell(const int i0, const int i1, const int j0, const int j1) : i0(i0), i1(i1), j0(j0), j1(j1) {}
+      int i0, i1, j0, j1;
+    };
+
+    string journal;
+    Scalar blebbingStart, blebbingStep, leftShiftStart, leftShiftStep, stimulation, rateTolerance;
+    int blebbingCount, leftShiftCount;
+    vector<Cell> open, leaves;
+    map<string, Sample> samples;
+    mutable mutex lock;
+
+    Private(const string& journal, const Scalar blebbingStart, const Scalar blebbingStep, const int blebbingCount,
+	    const Scalar leftShiftStart, const Scalar leftShiftStep, const int leftShiftCount, const Scalar stimulation,
+	    const int coarseCells, const Scalar rateTolerance) :
+      journal(journal), blebbingStart(blebbingStart), blebbingStep(blebbingStep), leftShiftStart(leftShiftStart),
+      leftShiftStep(leftShiftStep), stimulation(stimulation), rateTolerance(rateTolerance),
+      blebbingCount(blebbingCount), leftShiftCount(leftShiftCount) {
+      vector<int> is = cut(blebbingCount, coarseCells), js = cut(leftShiftCount, coarseCells);
+      for(size_t a = 0;a + 1 < is.size();a++) {
+	for(size_t b = 0;b + 1 < js.size();b++) {
+	  open.push_back(Cell(is[a], is[a + 1], js[b], js[b + 1]));
+	}
+      }
+
+      ifstream input(journal.c_str());
+      string line;
+      while(getline(input, line)) {
+	stringstream fields(line);
+	SweepPoint point;
+	Sample sample;
+	int regime;
+	if(fields >> point.blebbing >> point.leftShift >> point.stimulation >> sample.rate >> regime) {
+	  sample.regime = (SpikeAnalyzer::Regime)regime;
+	  samples[point.key()] = sample;
+	}
+      }
+    }
+
+    // Indices of cells evenly spread over count points, at least one point apart.
+    static vector<int> cut(const int count, const int cells) {
+      vector<int> indices;
+      int pieces = max(1, min(cells, count - 1));
+      for(int k = 0;k <= pieces;k++) {
+	int index = (int)llround((Scalar)k * (count - 1) / pieces);
+	if(indices.empty() || index != indices.back()) {
+	  indices.push_back(index);
+	}
+      }
+      return indices;
+    }
+
+    SweepPoint point(const int i, const int j) const {
+      return SweepPoint(blebbingStart + i*blebbingStep, leftShiftStart + j*leftShiftStep, stimulation);
+    }
+
+    const Sample* find(const int i, const int j) const {
+      map<string, Sample>::const_iterator sample = samples.find(point(i, j).key());
+      return sample == samples.end() ? NULL : &sample->second;
+    }
+
+    bool isUniform(const Sample* corners[4]) const {
+      for(int k = 1;k < 4;k++) {
+	if(corners[k]->regime != corners[0]->regime) {
+	  return false;
+	}
+      }
+      return true;
+    }
+
+    // Bilinear in the corners of cell.
+    static Scalar interpolate(const Cell& cell, const Sample* corners[4], const int i, const int j) {
+      Scalar x = (Scalar)(i - cell.i0) / (cell.i1 - cell.i0), y = (Scalar)(j - cell.j0) / (cell.j1 - cell.j0);
+      return (1 - x) * (1 - y) * corners[0]->rate + x * (1 - y) * corners[1]->rate
+	+ (1 - x) * y * corners[2]->rate + x * y * corners[3]->rate;
+    }
+
+    static int middle(const int low, const int high) {
+      return high - low > 1 ? (low + high) / 2 : high;
+    }
+
+    vector<SweepPoint> next() {
+      lock_guard<mutex> guard(lock);
+      vector<SweepPoint> needed;
+      set<string> seen;
+      bool changed = true;
+      while(changed) {
+	changed = false;
+	vector<Cell> waiting;
+	for(size_t k = 0;k < open.size();k++) {
+	  const Cell& cell = open[k];
+	  const Sample* corners[4] = {find(cell.i0, cell.j0), find(cell.i1, cell.j0), find(cell.i0, cell.j1), find(cell.i1, cell.j1)};
+	  if(!corners[0] || !corners[1] || !corners[2] || !corners[3]) {
+	    waiting.push_back(cell);
+	    continue;
+	  }
+	  if(cell.i1 - cell.i0 <= 1 && cell.j1 - cell.j0 <= 1) {
+	    leaves.push_back(cell);
+	    changed = true;
+	    continue;
+	  }
+	  // Halves only the sides longer than one grid step.
+	  int i = middle(cell.i0, cell.i1), j = middle(cell.j0, cell.j1);
+	  bool split = !isUniform(corners);
+	  if(!split) {
+	    // The middle decides whether the corners tell all about the inside.
+	    const Sample* center = find(i, j);
+	    if(!center) {
+	      waiting.push_back(cell);
+	      continue;
+	    }
+	    split = center->regime != corners[0]->regime
+	      || fabs(center->rate - interpolate(cell, corners, i, j)) > rateTolerance;
+	  }
+	  changed = true;
+	  if(!split) {
+	    leaves.push_back(cell);
+	    continue;
+	  }
+	  waiting.push_back(Cell(cell.i0, i, cell.j0, j));
+	  if(i != cell.i1) {
+	    waiting.push_back(Cell(i, cell.i1, cell.j0, j));
+	  }
+	  if(j != cell.j1) {
+	    waiting.push_back(Cell(cell.i0, i, j, cell.j1));
+	  }
+	  if(i != cell.i1 && j != cell.j1) {
+	    waiting.push_back(Cell(i, cell.i1, j, cell.j1));
+	  }
+	}
+	open.swap(waiting);
+      }
+      // What every cell still open waits for, its corners first and then its middle.
+      for(size_t k = 0;k < open.size();k++) {
+	const Cell& cell = open[k];
+	const int is[2] = {cell.i0, cell.i1}, js[2] = {cell.j0, cell.j1};
+	vector<SweepPoint> missing;
+	for(int a = 0;a < 2;a++) {
+	  for(int b = 0;b < 2;b++) {
+	    if(!find(is[a], js[b])) {
+	      missing.push_back(point(is[a], js[b]));
+	    }
+	  }
+	}
+	if(missing.empty()) {
+	  missing.push_back(point(middle(cell.i0, cell.i1), middle(cell.j0, cell.j1)));
+	}
+	for(size_t m = 0;m < missing.size();m++) {
+	  if(seen.insert(missing[m].key()).second) {
+	    needed.push_back(missing[m]);
+	  }
+	}
+      }
+      return needed;
+    }
+
+    void record(const SweepPoint& point, const Sample& sample) {
+      lock_guard<mutex> guard(lock);
+      ofstream output(journal.c_str(), ios::app);
+      output << point.key() << "\t" << sample.rate << "\t" << (int)sample.regime << endl;
+      samples[point.key()] = sample;
+    }
+
+    void write(const string& path) const {
+      lock_guard<mutex> guard(lock);
+      vector<Sample> grid(blebbingCount * leftShiftCount);
+      vector<bool> sampled(grid.size(), false);
+      for(size_t k = 0;k < leaves.size();k++) {
+	const Cell& cell = leaves[k];
+	const Sample* corners[4] = {find(cell.i0, cell.j0), find(cell.i1, cell.j0), find(cell.i0, cell.j1), find(cell.i1, cell.j1)};
+	for(int i = cell.i0;i <= cell.i1;i++) {
+	  for(int j = cell.j0;j <= cell.j1;j++) {
+	    const Sample* sample = find(i, j);
+	    if(sample) {
+	      grid[i * leftShiftCount + j] = *sample;
+	      sampled[i * leftShiftCount + j] = true;
+	      continue;
+	    }
+	    // The corners agree on the regime.
+	    grid[i * leftShiftCount + j] = Sample(interpolate(cell, corners, i, j), corners[0]->regime);
+	  }
+	}
+      }
+
+      ofstream output(path.c_str());
+      output << "blebbing\tleft shift (mV)\tstimulation\trate (Hz)\tregime\tsampled\n";
+      for(int i = 0;i < blebbingCount;i++) {
+	for(int j = 0;j < leftShiftCount;j++) {
+	  const SweepPoint at = point(i, j);
+	  const Sample& sample = grid[i * leftShiftCount + j];
+	  output << at.blebbing << "\t" << at.leftShift << "\t" << at.stimulation << "\t" << sample.rate << "\t"
+		 << SpikeAnalyzer::regimeName(sample.regime) << "\t" << sampled[i * leftShiftCount + j] << "\n";
+	}
+      }
+    }
+  };
+
+  Refinement::Refinement(const string& journal, const Scalar blebbingStart, const Scalar blebbingStep,
+			 const int blebbingCount, const Scalar leftShiftStart, const Scalar leftShiftStep,
+			 const int leftShiftCount, const Scalar stimulation, const int coarseCells,
+			 const Scalar rateTolerance) :
+    priv(new Private(journal, blebbingStart, blebbingStep, blebbingCount, leftShiftStart, leftShiftStep, leftShiftCount,
+		     stimulation, coarseCells, rateTolerance)) {}
+
+  Refinement::~Refinement() {
+    delete priv;
+  }
+
+  vector<SweepPoint> Refinement::next() {
+    return priv->next();
+  }
+
+  void Refinement::record(const SweepPoint& point, const Sample& sample) {
+    priv->record(point, sample);
+  }
+
+  int Refinement::getSampleCount() const {
+    lock_guard<mutex> guard(priv->lock);
+    return priv->samples.size();
+  }
+
+  void Refinement::write(const string& path) const {
+    priv->write(path);
+  }
+}
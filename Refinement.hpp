@@ -0,0 +1,50 @@
+#ifndef REFINEMENT_HPP
+#define REFINEMENT_HPP
+
+#include "SpikeAnalyzer.hpp"
+#include "Sweep.hpp"
+#include <string>
+#include <vector>
+
+namespace Jarl {
+  /*
+   * Adaptive sampling of the blebbing x leftShift grid Sweep::addGrid would
+   * run densely. The grid is first cut into coarse cells, and a cell is
+   * split in four, down to neighbouring grid points, while its corners
+   * differ in regime or its middle differs from them in regime or by more
+   * than rateTolerance from their interpolated rate. The other cells are
+   * filled in by interpolation, so sampling concentrates on the boundaries
+   * between regimes. A feature that fits inside a coarse cell without
+   * touching its corners or middle is missed, so coarseCells must stay fine
+   * enough for the smallest one.
+   * Every sample is appended to the journal and read back on construction,
+   * so an interrupted refinement picks up where it stopped.
+   */
+  class Refinement {
+  public:
+    class Sample {
+    public:
+      Sample();
+      Sample(const Scalar rate, const SpikeAnalyzer::Regime regime);
+      Scalar rate;
+      SpikeAnalyzer::Regime regime;
+    };
+    Refinement(const std::string& journal, const Scalar blebbingStart, const Scalar blebbingStep, const int blebbingCount,
+	       const Scalar leftShiftStart, const Scalar leftShiftStep, const int leftShiftCount, const Scalar stimulation,
+	       const int coarseCells = 8, const Scalar rateTolerance = 1);
+    ~Refinement();
+    // Refines as far as the samples so far allow and returns the points it needs next, none once it is done.
+    std::vector<SweepPoint> next();
+    void record(const SweepPoint& point, const Sample& sample);
+    int getSampleCount() const;
+    // The whole grid, one line per point, the points not sampled interpolated.
+    void write(const std::string& path) const;
+  private:
+    Refinement(const Refinement&);
+    Refinement& operator=(const Refinement&);
+    class Private;
+    Private* const priv;
+  };
+}
+
+#endif
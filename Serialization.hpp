@@ -0,0 +1,56 @@
+#ifndef SERIALIZATION_HPP
+#define SERIALIZATION_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace Jarl {
+  // Raw host byte order helpers shared by the trace and snapshot formats.
+  template<typename T>
+  inline void writeBinary(std::ostream& output, const T& value) {
+    output.write((const char*)&value, sizeof(value));
+  }
+
+  template<typename T>
+  inline bool readBinary(std::istream& input, T& value) {
+    return (bool)input.read((char*)&value, sizeof(value));
+  }
+
+  inline void writeString(std::ostream& output, const std::string& value) {
+    uint32_t length = value.size();
+    writeBinary(output, length);
+    output.write(value.data(), length);
+  }
+
+  inline bool readString(std::istream& input, std::string& value) {
+    uint32_t length;
+    if(!readBinary(input, length)) {
+      return false;
+    }
+    value.resize(length);
+    return length == 0 || (bool)input.read(&value[0], length);
+  }
+
+  template<typename T>
+  inline void writeVector(std::ostream& output, const std::vector<T>& values) {
+    uint64_t size = values.size();
+    writeBinary(output, size);
+    if(size > 0) {
+      output.write((const char*)&values[0], size * sizeof(T));
+    }
+  }
+
+  template<typename T>
+  inline bool readVector(std::istream& input, std::vector<T>& values) {
+    uint64_t size;
+    if(!readBinary(input, size)) {
+      return false;
+    }
+    values.resize(size);
+    return size == 0 || (bool)input.read((char*)&values[0], size * sizeof(T));
+  }
+}
+
+#endif
@@ -0,0 +1,131 @@
+#include "SpikeAnalyzer.hpp"
+#include "Serialization.hpp"
+#include <algorithm>
+#include <math.h>
+#include <sstream>
+
+using namespace std;
+
+namespace Jarl {
+  SpikeAnalyzer::SpikeAnalyzer(const Scalar threshold, const Scalar window) :
+    threshold(threshold), window(window), intervals(0), intervalMean(0), intervalSquares(0) {}
+
+  bool SpikeAnalyzer::observe(const Scalar lastTime, const Scalar lastPotential, const Scalar time, const Scalar potential) {
+    if(!(potential > threshold && lastPotential <= threshold)) {
+      return false;
+    }
+    add(lastTime + (threshold - lastPotential) / (potential - lastPotential) * (time - lastTime));
+    return true;
+  }
+
+  void SpikeAnalyzer::add(const Scalar spike) {
+    if(!spikes.empty()) {
+      // Welford's update of the interval mean and sum of squared deviations.
+      Scalar interval = spike - spikes.back();
+      intervals++;
+      Scalar delta = interval - intervalMean;
+      intervalMean += delta / intervals;
+      intervalSquares += delta * (interval - intervalMean);
+    }
+    spikes.push_back(spike);
+  }
+
+  void SpikeAnalyzer::extrapolate(const vector<Scalar>& intervals, const Scalar end) {
+    if(spikes.empty() || intervals.empty()) {
+      return;
+    }
+    for(size_t i = 0;spikes.back() + intervals[i] <= end;i = (i + 1) % intervals.size()) {
+      add(spikes.back() + intervals[i]);
+    }
+  }
+
+  int SpikeAnalyzer::getSpikeCount() const {
+    return spikes.size();
+  }
+
+  const vector<Scalar>& SpikeAnalyzer::getSpikeTimes() const {
+    return spikes;
+  }
+
+  vector<Scalar> SpikeAnalyzer::getInterSpikeIntervals() const {
+    vector<Scalar> result;
+    for(size_t i = 1;i < spikes.size();i++) {
+      result.push_back(spikes[i] - spikes[i - 1]);
+    }
+    return result;
+  }
+
+  Scalar SpikeAnalyzer::getMeanInterval() const {
+    return intervals > 0 ? intervalMean : 0;
+  }
+
+  // Coefficient of variation of the interspike intervals.
+  Scalar SpikeAnalyzer::getIntervalVariation() const {
+    if(intervals < 2 || intervalMean == 0) {
+      return 0;
+    }
+    return sqrt(intervalSquares / (intervals - 1)) / intervalMean;
+  }
+
+  // Spikes per second over the window ending at end.
+  Scalar SpikeAnalyzer::getRate(const Scalar end) const {
+    vector<Scalar>::const_iterator first = upper_bound(spikes.begin(), spikes.end(), end - window);
+    vector<Scalar>::const_iterator last = upper_bound(spikes.begin(), spikes.end(), end);
+    return (last - first) / (window / 1000);
+  }
+
+  /*
+   * Firing over the window ending at end: quiescent with fewer than two
+   * spikes, bursting when the interspike intervals vary by more than half
+   * their mean, i.e. bursts separated by pauses, and tonic otherwise.
+   */
+  SpikeAnalyzer::Regime SpikeAnalyzer::getRegime(const Scalar end) const {
+    vector<Scalar>::const_iterator first = upper_bound(spikes.begin(), spikes.end(), end - window);
+    vector<Scalar>::const_iterator last = upper_bound(spikes.begin(), spikes.end(), end);
+    if(last - first < 3) {
+      return last - first < 2 ? Quiescent : Tonic;
+    }
+    Scalar count = 0, mean = 0, squares = 0;
+    for(vector<Scalar>::const_iterator spike = first + 1;spike != last;spike++) {
+      Scalar interval = *spike - *(spike - 1);
+      count++;
+      Scalar delta = interval - mean;
+      mean += delta / count;
+      squares += delta * (interval - mean);
+    }
+    return sqrt(squares / (count - 1)) > mean / 2 ? Bursting : Tonic;
+  }
+
+  string SpikeAnalyzer::regimeName(const Regime regime) {
+    static const char* names[] = {"quiescent", "tonic", "bursting"};
+    return names[regime];
+  }
+
+  string SpikeAnalyzer::header() {
+    return "spikes\trate (Hz)\tmean interval (ms)\tinterval cv\tfirst spike (ms)\tlast spike (ms)";
+  }
+
+  string SpikeAnalyzer::summary(const Scalar end) const {
+    stringstream stream;
+    stream << spikes.size() << "\t" << getRate(end) << "\t" << getMeanInterval() << "\t" << getIntervalVariation() << "\t"
+	   << (spikes.empty() ? 0 : spikes.front()) << "\t" << (spikes.empty() ? 0 : spikes.back());
+    return stream.str();
+  }
+
+  void SpikeAnalyzer::save(ostream& stream) const {
+    writeVector(stream, spikes);
+    writeBinary(stream, (int32_t)intervals);
+    writeBinary(stream, intervalMean);
+    writeBinary(stream, intervalSquares);
+  }
+
+  bool SpikeAnalyzer::restore(istream& stream) {
+    int32_t count;
+    if(!readVector(stream, spikes) || !readBinary(stream, count)
+       || !readBinary(stream, intervalMean) || !readBinary(stream, intervalSquares)) {
+      return false;
+    }
+    intervals = count;
+    return true;
+  }
+}
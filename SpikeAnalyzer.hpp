@@ -0,0 +1,45 @@
+#ifndef SPIKE_ANALYZER_HPP
+#define SPIKE_ANALYZER_HPP
+
+#include "HodgkinHuxley.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace Jarl {
+  /*
+   * Streaming spike statistics fed from the stepping loop after every
+   * accepted step. Spike times are the upward threshold crossings, linearly
+   * interpolated between the two steps around them.
+   */
+  class SpikeAnalyzer {
+  public:
+    enum Regime { Quiescent, Tonic, Bursting };
+    SpikeAnalyzer(const Scalar threshold, const Scalar window = 5000);
+    bool observe(const Scalar lastTime, const Scalar lastPotential, const Scalar time, const Scalar potential);
+    // Continues the spike train to end by repeating intervals, for a run stopped once it was periodic.
+    void extrapolate(const std::vector<Scalar>& intervals, const Scalar end);
+    int getSpikeCount() const;
+    const std::vector<Scalar>& getSpikeTimes() const;
+    std::vector<Scalar> getInterSpikeIntervals() const;
+    Scalar getMeanInterval() const;
+    Scalar getIntervalVariation() const;
+    Scalar getRate(const Scalar end) const;
+    Regime getRegime(const Scalar end) const;
+    static std::string regimeName(const Regime regime);
+    static std::string header();
+    std::string summary(const Scalar end) const;
+    void save(std::ostream& stream) const;
+    bool restore(std::istream& stream);
+  private:
+    void add(const Scalar spike);
+    Scalar threshold;
+    Scalar window;
+    std::vector<Scalar> spikes;
+    int intervals;
+    Scalar intervalMean;
+    Scalar intervalSquares;
+  };
+}
+
+#endif
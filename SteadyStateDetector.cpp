@@ -0,0 +1,223 @@
+#include "SteadyStateDetector.hpp"
+#include "Serialization.hpp"
+#include <algorithm>
+#include <math.h>
+
+using namespace std;
+
+namespace Jarl {
+  SteadyStateDetector::SteadyStateDetector(const Scalar threshold) :
+    threshold(threshold), maximumPeriod(8), checkInterval(1000), intervalTolerance(1e-3) {
+    // In mV for the potential and mM for the concentrations, which move the reversal potentials by about .3 mV.
+    tolerance[HodgkinHuxley::Potential] = .5;
+    for(int i = HodgkinHuxley::N;i < HodgkinHuxley::InnerPotassiumConcentration;i++) {
+      tolerance[i] = 5e-3;
+    }
+    for(int i = HodgkinHuxley::InnerPotassiumConcentration;i < HodgkinHuxley::Variables;i++) {
+      tolerance[i] = .05;
+    }
+    reset();
+  }
+
+  void SteadyStateDetector::reset() {
+    outcome = Unsettled;
+    settledTime = 0;
+    period.clear();
+    started = false;
+    hasChange = false;
+    crossings.clear();
+    matchedPeriod = 0;
+    repeated = false;
+    checkSpikes = 0;
+    meanIntervals.clear();
+  }
+
+  /*
+   * Whether a quantity that changed by previous and then by change over
+   * equal spans has settled: shrinking by change / previous every span, it
+   * has change * ratio / (1 - ratio) left to go.
+   */
+  bool SteadyStateDetector::isSettling(const Scalar change, const Scalar previous, const Scalar tolerance) {
+    if(fabs(change) <= 1e-3 * tolerance) {
+      return true;
+    }
+    Scalar ratio = fabs(change) / fabs(previous);
+    return ratio < 1 && fabs(change) * ratio / (1 - ratio) <= tolerance;
+  }
+
+  bool SteadyStateDetector::observe(const Scalar time, const HodgkinHuxley& neuron) {
+    if(outcome != Unsettled) {
+      return true;
+    }
+    Scalar y[HodgkinHuxley::Variables];
+    neuron.getState(y);
+    if(!started) {
+      started = true;
+      lastTime = checkTime = time;
+      copy(y, y + HodgkinHuxley::Variables, last);
+      copy(y, y + HodgkinHuxley::Variables, checkState);
+      return false;
+    }
+
+    if(y[HodgkinHuxley::Potential] > threshold && last[HodgkinHuxley::Potential] <= threshold && time > lastTime) {
+      // The state at the crossing, interpolated like SpikeAnalyzer's spike time.
+      Crossing crossing;
+      Scalar fraction = (threshold - last[HodgkinHuxley::Potential]) / (y[HodgkinHuxley::Potential] - last[HodgkinHuxley::Potential]);
+      crossing.time = lastTime + fraction * (time - lastTime);
+      for(int i = 0;i < HodgkinHuxley::Variables;i++) {
+	crossing.state[i] = last[i] + fraction * (y[i] - last[i]);
+      }
+      crossings.push_back(crossing);
+      if((int)crossings.size() > 2 * maximumPeriod + 1) {
+	crossings.pop_front();
+      }
+      if(checkSpikes++ == 0) {
+	checkFirstSpike = crossing.time;
+      }
+
+      int found = 0;
+      for(int candidate = 1;candidate <= maximumPeriod && !found;candidate++) {
+	if(isPeriodic(candidate)) {
+	  found = candidate;
+	}
+      }
+      repeated = found && found == matchedPeriod;
+      matchedPeriod = found;
+    }
+
+    if(time - checkTime >= checkInterval) {
+      check(time, y);
+    }
+    lastTime = time;
+    copy(y, y + HodgkinHuxley::Variables, last);
+    return outcome != Unsettled;
+  }
+
+  // Closes a span of exactly checkInterval, so consecutive changes compare like with like.
+  void SteadyStateDetector::check(const Scalar time, Scalar* y) {
+    Scalar at[HodgkinHuxley::Variables];
+    Scalar fraction = checkInterval / (time - checkTime);
+    for(int i = 0;i < HodgkinHuxley::Variables;i++) {
+      at[i] = checkState[i] + fraction * (y[i] - checkState[i]);
+    }
+    if(checkSpikes == 0) {
+      meanIntervals.clear();
+      if(isRest(at)) {
+	outcome = Rest;
+	settledTime = time;
+      }
+    } else {
+      hasChange = false;
+      if(checkSpikes < 2) {
+	meanIntervals.clear();
+      } else {
+	meanIntervals.push_back((crossings.back().time - checkFirstSpike) / (checkSpikes - 1));
+	if(meanIntervals.size() > 3) {
+	  meanIntervals.erase(meanIntervals.begin());
+	}
+	const int count = meanIntervals.size();
+	if(count == 3 && repeated
+	   && isSettling(meanIntervals[2] - meanIntervals[1], meanIntervals[1] - meanIntervals[0],
+			 intervalTolerance * meanIntervals[2])) {
+	  outcome = Periodic;
+	  settledTime = time;
+	  for(size_t k = crossings.size() - matchedPeriod;k < crossings.size();k++) {
+	    period.push_back(crossings[k].time - crossings[k - 1].time);
+	  }
+	}
+      }
+    }
+    checkTime += checkInterval;
+    copy(at, at + HodgkinHuxley::Variables, checkState);
+    checkSpikes = 0;
+  }
+
+  bool SteadyStateDetector::isRest(const Scalar* y) {
+    bool rest = hasChange;
+    for(int i = 0;i < HodgkinHuxley::Variables;i++) {
+      Scalar change = y[i] - checkState[i];
+      if(hasChange && !isSettling(change, checkChange[i], tolerance[i])) {
+	rest = false;
+      }
+      checkChange[i] = change;
+    }
+    hasChange = true;
+    return rest;
+  }
+
+  // Whether the last two periods of period crossings agree.
+  bool SteadyStateDetector::isPeriodic(const int period) const {
+    const int count = crossings.size();
+    if(count < 2 * period + 1) {
+      return false;
+    }
+    for(int k = count - period;k < count;k++) {
+      Scalar interval = crossings[k].time - crossings[k - 1].time;
+      Scalar before = crossings[k - period].time - crossings[k - period - 1].time;
+      if(fabs(interval - before) > intervalTolerance * interval) {
+	return false;
+      }
+    }
+    const Crossing& now = crossings[count - 1];
+    const Crossing& before = crossings[count - 1 - period];
+    for(int i = HodgkinHuxley::N;i < HodgkinHuxley::InnerPotassiumConcentration;i++) {
+      if(fabs(now.state[i] - before.state[i]) > tolerance[i]) {
+	return false;
+      }
+    }
+    return true;
+  }
+
+  SteadyStateDetector::Outcome SteadyStateDetector::getOutcome() const {
+    return outcome;
+  }
+
+  Scalar SteadyStateDetector::getSettledTime() const {
+    return settledTime;
+  }
+
+  const vector<Scalar>& SteadyStateDetector::getPeriod() const {
+    return period;
+  }
+
+  void SteadyStateDetector::save(ostream& stream) const {
+    writeBinary(stream, (int32_t)outcome);
+    writeBinary(stream, settledTime);
+    writeVector(stream, period);
+    writeBinary(stream, (uint8_t)started);
+    writeBinary(stream, lastTime);
+    writeBinary(stream, last);
+    writeBinary(stream, checkTime);
+    writeBinary(stream, checkState);
+    writeBinary(stream, checkChange);
+    writeBinary(stream, (uint8_t)hasChange);
+    writeVector(stream, vector<Crossing>(crossings.begin(), crossings.end()));
+    writeBinary(stream, (int32_t)matchedPeriod);
+    writeBinary(stream, (uint8_t)repeated);
+    writeBinary(stream, (int32_t)checkSpikes);
+    writeBinary(stream, checkFirstSpike);
+    writeVector(stream, meanIntervals);
+  }
+
+  bool SteadyStateDetector::restore(istream& stream) {
+    int32_t outcome, matchedPeriod, checkSpikes;
+    uint8_t started, hasChange, repeated;
+    vector<Crossing> crossings;
+    if(!readBinary(stream, outcome) || !readBinary(stream, settledTime) || !readVector(stream, period)
+       || !readBinary(stream, started) || !readBinary(stream, lastTime) || !readBinary(stream, last)
+       || !readBinary(stream, checkTime) || !readBinary(stream, checkState) || !readBinary(stream, checkChange)
+       || !readBinary(stream, hasChange) || !readVector(stream, crossings) || !readBinary(stream, matchedPeriod)
+       || !readBinary(stream, repeated) || !readBinary(stream, checkSpikes) || !readBinary(stream, checkFirstSpike)
+       || !readVector(stream, meanIntervals)) {
+      return false;
+    }
+    this->outcome = (Outcome)outcome;
+    this->started = started;
+    this->hasChange = hasChange;
+    this->crossings.assign(crossings.begin(), crossings.end());
+    this->matchedPeriod = matchedPeriod;
+    this->repeated = repeated;
+    this->checkSpikes = checkSpikes;
+    return true;
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef STEADY_STATE_DETECTOR_HPP
+#define STEADY_STATE_DETECTOR_HPP
+
+#include "HodgkinHuxley.hpp"
+#include <deque>
+#include <iostream>
+#include <vector>
+
+namespace Jarl {
+  /*
+   * Watches a run whose parameters no longer change for the point from
+   * which the rest of it is predictable. The concentrations keep relaxing
+   * long after the membrane has settled, so nothing is ever exactly still
+   * or exactly periodic. Instead a quantity is checked every checkInterval
+   * ms and counts as settled once its change over one interval is smaller
+   * than over the one before, and the change still to come, taking it to
+   * keep shrinking geometrically, is within tolerance.
+   * Rest is every variable settled without a spike. A limit cycle
+   * is the spike train repeating with a period of up to maximumPeriod
+   * spikes, the intervals agreeing to intervalTolerance and the gates at
+   * the threshold crossings to their tolerance, while the mean interval of
+   * each checkInterval has settled.
+   */
+  class SteadyStateDetector {
+  public:
+    enum Outcome { Unsettled, Rest, Periodic };
+    SteadyStateDetector(const Scalar threshold);
+    // Forgets everything seen so far, for when the parameters change.
+    void reset();
+    // After every step; true once the run has settled.
+    bool observe(const Scalar time, const HodgkinHuxley& neuron);
+    Outcome getOutcome() const;
+    Scalar getSettledTime() const;
+    // The intervals of one period of the limit cycle.
+    const std::vector<Scalar>& getPeriod() const;
+    // What has been seen so far, for checkpoints; the tolerances are the constructor's.
+    void save(std::ostream& stream) const;
+    bool restore(std::istream& stream);
+  private:
+    class Crossing {
+    public:
+      Scalar time;
+      Scalar state[HodgkinHuxley::Variables];
+    };
+    static bool isSettling(const Scalar change, const Scalar previous, const Scalar tolerance);
+    bool isRest(const Scalar* y);
+    bool isPeriodic(const int period) const;
+    void check(const Scalar time, Scalar* y);
+    Scalar threshold;
+    int maximumPeriod;
+    Scalar checkInterval;
+    Scalar intervalTolerance;
+    Scalar tolerance[HodgkinHuxley::Variables];
+    Outcome outcome;
+    Scalar settledTime;
+    std::vector<Scalar> period;
+    bool started;
+    Scalar lastTime;
+    Scalar last[HodgkinHuxley::Variables];
+    Scalar checkTime;
+    Scalar checkState[HodgkinHuxley::Variables];
+    Scalar checkChange[HodgkinHuxley::Variables];
+    bool hasChange;
+    std::deque<Crossing> crossings;
+    int matchedPeriod;
+    bool repeated;
+    int checkSpikes;
+    Scalar checkFirstSpike;
+    std::vector<Scalar> meanIntervals;
+  };
+}
+
+#endif
@@ -0,0 +1,296 @@
+#include "Sweep.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdio.h>
+#include <thread>
+
+using namespace std;
+
+namespace Jarl {
+  class WorkStealingPool::Private {
+  public:
+    class Worker {
+    public:
+      mutex lock;
+      deque<function<void()> > tasks;
+    };
+
+    vector<Worker*> workers;
+    vector<thread> threads;
+    mutex lock;
+    condition_variable wake, idle;
+    atomic<int> queued, pending;
+    int next;
+    bool stopping;
+
+    static thread_local Private* currentPool;
+    static thread_local int currentWorker;
+
+    Private(int count) : queued(0), pending(0), next(0), stopping(false) {
+      if(count <= 0) {
+	count = max<int>(1, thread::hardware_concurrency());
+      }
+      for(int i = 0;i < count;i++) {
+	workers.push_back(new Worker());
+      }
+      for(int i = 0;i < count;i++) {
+	threads.push_back(thread(&Private::work, this, i));
+      }
+    }
+
+    ~Private() {
+      {
+	lock_guard<mutex> guard(lock);
+	stopping = true;
+      }
+      wake.notify_all();
+      for(size_t i = 0;i < threads.size();i++) {
+	threads[i].join();
+      }
+      for(size_t i = 0;i < workers.size();i++) {
+	delete workers[i];
+      }
+    }
+
+    // Counted before it is published, so a worker taking it never drives queued below zero.
+    void push(const int index, const function<void()>& task) {
+      {
+	lock_guard<mutex> guard(lock);
+	queued++;
+      }
+      {
+	lock_guard<mutex> guard(workers[index]->lock);
+	workers[index]->tasks.push_back(task);
+      }
+      wake.notify_one();
+    }
+
+    bool pop(const int index, function<void()>& task) {
+      Worker* worker = workers[index];
+      lock_guard<mutex> guard(worker->lock);
+      if(worker->tasks.empty()) {
+	return false;
+      }
+      task = worker->tasks.back();
+      worker->tasks.pop_back();
+      queued--;
+      return true;
+    }
+
+    bool steal(const int index, function<void()>& task) {
+      for(size_t offset = 1;offset < workers.size();offset++) {
+	Worker* victim = workers[(index + offset) % workers.size()];
+	lock_guard<mutex> guard(victim->lock);
+	if(!victim->tasks.empty()) {
+	  task = victim->tasks.front();
+	  victim->tasks.pop_front();
+	  queued--;
+	  return true;
+	}
+      }
+      return false;
+    }
+
+    void work(const int index) {
+      currentPool = this;
+      currentWorker = index;
+      function<void()> task;
+      while(true) {
+	if(pop(index, task) || steal(index, task)) {
+	  task();
+	  task = function<void()>();
+	  if(--pending == 0) {
+	    lock_guard<mutex> guard(lock);
+	    idle.notify_all();
+	  }
+	  continue;
+	}
+	unique_lock<mutex> guard(lock);
+	while(!stopping && queued == 0) {
+	  wake.wait(guard);
+	}
+	if(stopping) {
+	  return;
+	}
+      }
+    }
+  };
+
+  thread_local WorkStealingPool::Private* WorkStealingPool::Private::currentPool = NULL;
+  thread_local int WorkStealingPool::Private::currentWorker = -1;
+
+  WorkStealingPool::WorkStealingPool(const int threads) : priv(new Private(threads)) {}
+
+  WorkStealingPool::~WorkStealingPool() {
+    wait();
+    delete priv;
+  }
+
+  int WorkStealingPool::size() const {
+    return priv->workers.size();
+  }
+
+  void WorkStealingPool::submit(const function<void()>& task) {
+    priv->pending++;
+    if(Private::currentPool == priv) {
+      priv->push(Private::currentWorker, task);
+    } else {
+      int index;
+      {
+	lock_guard<mutex> guard(priv->lock);
+	index = priv->next;
+	priv->next = (priv->next + 1) % priv->workers.size();
+      }
+      priv->push(index, task);
+    }
+  }
+
+  void WorkStealingPool::wait() {
+    unique_lock<mutex> guard(priv->lock);
+    while(priv->pending != 0) {
+      priv->idle.wait(guard);
+    }
+  }
+
+  SweepPoint::SweepPoint() : blebbing(0), leftShift(0), stimulation(0) {}
+
+  SweepPoint::SweepPoint(const Scalar blebbing, const Scalar leftShift, const Scalar stimulation) :
+    blebbing(blebbing), leftShift(leftShift), stimulation(stimulation) {}
+
+  string SweepPoint::key() const {
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "%.17g\t%.17g\t%.17g", blebbing, leftShift, stimulation);
+    return buffer;
+  }
+
+  class Sweep::Private {
+  public:
+    string journal;
+    vector<SweepPoint> points;
+    set<string> finished;
+    mutex lock;
+
+    Private(const string& journal) : journal(journal) {
+      ifstream input(journal.c_str());
+      string line;
+      while(getline(input, line)) {
+	if(!line.empty()) {
+	  finished.insert(line);
+	}
+      }
+    }
+
+    void finish(const SweepPoint& point) {
+      string key = point.key();
+      lock_guard<mutex> guard(lock);
+      ofstream output(journal.c_str(), ios::app);
+      output << key << endl;
+      finished.insert(key);
+    }
+  };
+
+  Sweep::Sweep(const string& journal) : priv(new Private(journal)) {}
+
+  Sweep::~Sweep() {
+    delete priv;
+  }
+
+  void Sweep::add(const SweepPoint& point) {
+    priv->points.push_back(point);
+  }
+
+  void Sweep::addGrid(const Scalar blebbingStart, const Scalar blebbingStep, const int blebbingCount,
+		      const Scalar leftShiftStart, const Scalar leftShiftStep, const int leftShiftCount,
+		      const Scalar stimulation) {
+    for(int i = 0;i < blebbingCount;i++) {
+      for(int j = 0;j < leftShiftCount;j++) {
+	add(SweepPoint(blebbingStart + i*blebbingStep, leftShiftStart + j*leftShiftStep, stimulation));
+      }
+    }
+  }
+
+  bool Sweep::load(const string& manifest) {
+    ifstream input(manifest.c_str());
+    if(!input) {
+      return false;
+    }
+    vector<SweepPoint> loaded;
+    string line;
+    while(getline(input, line)) {
+      line = line.substr(0, line.find('#'));
+      stringstream fields(line);
+      string keyword;
+      if(!(fields >> keyword)) {
+	continue;
+      }
+      if(keyword == "grid") {
+	Scalar blebbingStart, blebbingStep, leftShiftStart, leftShiftStep, stimulation;
+	int blebbingCount, leftShiftCount;
+	if(!(fields >> blebbingStart >> blebbingStep >> blebbingCount >> leftShiftStart >> leftShiftStep >> leftShiftCount
+	     >> stimulation)) {
+	  return false;
+	}
+	for(int i = 0;i < blebbingCount;i++) {
+	  for(int j = 0;j < leftShiftCount;j++) {
+	    loaded.push_back(SweepPoint(blebbingStart + i*blebbingStep, leftShiftStart + j*leftShiftStep, stimulation));
+	  }
+	}
+      } else if(keyword == "point") {
+	SweepPoint point;
+	if(!(fields >> point.blebbing >> point.leftShift >> point.stimulation)) {
+	  return false;
+	}
+	loaded.push_back(point);
+      } else {
+	return false;
+      }
+    }
+    priv->points.insert(priv->points.end(), loaded.begin(), loaded.end());
+    return true;
+  }
+
+  void Sweep::shard(const int index, const int count) {
+    vector<SweepPoint> kept;
+    for(size_t i = index;i < priv->points.size();i += count) {
+      kept.push_back(priv->points[i]);
+    }
+    priv->points.swap(kept);
+  }
+
+  const vector<SweepPoint>& Sweep::getPoints() const {
+    return priv->points;
+  }
+
+  bool Sweep::isFinished(const SweepPoint& point) const {
+    lock_guard<mutex> guard(priv->lock);
+    return priv->finished.count(point.key()) != 0;
+  }
+
+  // Records point in the journal.
+  void Sweep::finish(const SweepPoint& point) {
+    priv->finish(point);
+  }
+
+  int Sweep::run(WorkStealingPool& pool, const function<void(const SweepPoint&)>& experiment) {
+    int submitted = 0;
+    for(size_t i = 0;i < priv->points.size();i++) {
+      const SweepPoint point = priv->points[i];
+      if(isFinished(point)) {
+	continue;
+      }
+      Private* sweep = priv;
+      pool.submit([sweep, point, experiment]() {
+	  experiment(point);
+	  sweep->finish(point);
+	});
+      submitted++;
+    }
+    pool.wait();
+    return submitted;
+  }
+}
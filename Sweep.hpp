@@ -0,0 +1,71 @@
+#ifndef SWEEP_HPP
+#define SWEEP_HPP
+
+#include "HodgkinHuxley.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Jarl {
+  /*
+   * Fixed set of worker threads, each with its own task deque. A worker runs
+   * its own tasks newest first and, once it runs dry, steals the oldest task
+   * of another worker, so long running tasks never leave cores idle.
+   */
+  class WorkStealingPool {
+  public:
+    explicit WorkStealingPool(const int threads = 0);
+    ~WorkStealingPool();
+    int size() const;
+    void submit(const std::function<void()>& task);
+    void wait();
+  private:
+    WorkStealingPool(const WorkStealingPool&);
+    WorkStealingPool& operator=(const WorkStealingPool&);
+    class Private;
+    Private* const priv;
+  };
+
+  class SweepPoint {
+  public:
+    SweepPoint();
+    SweepPoint(const Scalar blebbing, const Scalar leftShift, const Scalar stimulation);
+    std::string key() const;
+    Scalar blebbing;
+    Scalar leftShift;
+    Scalar stimulation;
+  };
+
+  /*
+   * A list of parameter points run on a WorkStealingPool. Every finished
+   * point is appended to the journal file, and points already in the journal
+   * are skipped, so an interrupted sweep picks up where it stopped.
+   * A manifest lists the points as lines of
+   *   grid blebbingStart blebbingStep blebbingCount leftShiftStart leftShiftStep leftShiftCount stimulation
+   *   point blebbing leftShift stimulation
+   * with # starting a comment, see sweeps/reference.sweep.
+   */
+  class Sweep {
+  public:
+    Sweep(const std::string& journal);
+    ~Sweep();
+    void add(const SweepPoint& point);
+    void addGrid(const Scalar blebbingStart, const Scalar blebbingStep, const int blebbingCount,
+		 const Scalar leftShiftStart, const Scalar leftShiftStep, const int leftShiftCount,
+		 const Scalar stimulation);
+    bool load(const std::string& manifest);
+    // Keeps every count-th point from the index-th on, so the shards of one manifest never overlap.
+    void shard(const int index, const int count);
+    const std::vector<SweepPoint>& getPoints() const;
+    bool isFinished(const SweepPoint& point) const;
+    void finish(const SweepPoint& point);
+    int run(WorkStealingPool& pool, const std::function<void(const SweepPoint&)>& experiment);
+  private:
+    Sweep(const Sweep&);
+    Sweep& operator=(const Sweep&);
+    class Private;
+    Private* const priv;
+  };
+}
+
+#endif
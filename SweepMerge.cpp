@@ -0,0 +1,81 @@
+#include "Sweep.hpp"
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace Jarl;
+
+/*
+ * SweepMerge manifest output directory... joins the summary.tsv of every
+ * shard directory into one table in the order of manifest. A point run
+ * more than once, by a restarted shard, keeps its last line. Points without
+ * a line are listed on stderr and make the exit status 2, so the merge can
+ * simply be repeated once the missing shards have finished.
+ */
+
+// The key summary.tsv lines start with, formatted the way appendSummary writes it.
+static string key(const SweepPoint& point) {
+  stringstream stream;
+  stream << point.blebbing << "\t" << point.leftShift << "\t" << point.stimulation;
+  return stream.str();
+}
+
+int main(int argc, char* argv[]) {
+  if(argc < 4) {
+    cerr << "usage: " << argv[0] << " manifest output directory..." << endl;
+    return 1;
+  }
+  Sweep sweep("/dev/null");
+  if(!sweep.load(argv[1])) {
+    cerr << argv[1] << ": not a sweep manifest" << endl;
+    return 1;
+  }
+
+  string header;
+  map<string, string> lines;
+  for(int i = 3;i < argc;i++) {
+    string path = string(argv[i]) + "/summary.tsv";
+    ifstream input(path.c_str());
+    if(!input) {
+      cerr << path << ": cannot open" << endl;
+      continue;
+    }
+    string line;
+    getline(input, header);
+    while(getline(input, line)) {
+      // A line cut short by a killed shard has fewer fields than the header.
+      if(count(line.begin(), line.end(), '\t') != count(header.begin(), header.end(), '\t')) {
+	continue;
+      }
+      size_t end = line.find('\t');
+      end = line.find('\t', end + 1);
+      end = line.find('\t', end + 1);
+      lines[line.substr(0, end)] = line;
+    }
+  }
+
+  ofstream output(argv[2]);
+  if(!output) {
+    cerr << argv[2] << ": cannot open" << endl;
+    return 1;
+  }
+  output << header << "\n";
+  const vector<SweepPoint>& points = sweep.getPoints();
+  int missing = 0;
+  for(size_t i = 0;i < points.size();i++) {
+    map<string, string>::const_iterator line = lines.find(key(points[i]));
+    if(line == lines.end()) {
+      cerr << "missing " << key(points[i]) << endl;
+      missing++;
+      continue;
+    }
+    output << line->second << "\n";
+  }
+  output.close();
+  cerr << points.size() - missing << " of " << points.size() << " points merged" << endl;
+  return missing > 0 ? 2 : 0;
+}
@@ -0,0 +1,442 @@
+#include "Trace.hpp"
+#include "Serialization.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <math.h>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+
+namespace Jarl {
+  static const char traceMagic[8] = {'H', 'H', 'T', 'R', 'A', 'C', 'E', '\0'};
+  static const uint32_t traceVersion = 1;
+  static const uint32_t compressedTraceVersion = 2;
+  enum Codec { Xor, Delta };
+
+  static uint64_t toBits(const Scalar value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
+
+  static Scalar fromBits(const uint64_t bits) {
+    Scalar value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  static void writeVarint(string& output, uint64_t value) {
+    while(value >= 0x80) {
+      output.push_back((char)(value | 0x80));
+      value >>= 7;
+    }
+    output.push_back((char)value);
+  }
+
+  static bool readVarint(const unsigned char*& input, const unsigned char* end, uint64_t& value) {
+    value = 0;
+    for(int shift = 0;shift < 64 && input < end;shift += 7) {
+      uint64_t byte = *input++;
+      value |= (byte & 0x7f) << shift;
+      if(!(byte & 0x80)) {
+	return true;
+      }
+    }
+    return false;
+  }
+
+  // The bit patterns are subtracted as unsigned integers, so decoding restores them exactly.
+  static void encodeColumn(const Scalar* values, const int rows, const Codec codec, string& output) {
+    output.push_back((char)codec);
+    uint64_t previous = 0, previousDelta = 0;
+    for(int row = 0;row < rows;row++) {
+      uint64_t bits = toBits(values[row]);
+      if(codec == Xor) {
+	writeVarint(output, bits ^ previous);
+      } else {
+	uint64_t delta = bits - previous;
+	int64_t change = (int64_t)(delta - previousDelta);
+	writeVarint(output, ((uint64_t)change << 1) ^ (uint64_t)(change >> 63));
+	previousDelta = delta;
+      }
+      previous = bits;
+    }
+  }
+
+  static bool decodeColumn(const unsigned char*& input, const unsigned char* end, const int rows, Scalar* values,
+			   const int stride) {
+    if(input == end || *input > Delta) {
+      return false;
+    }
+    const Codec codec = (Codec)*input++;
+    uint64_t previous = 0, previousDelta = 0, value;
+    for(int row = 0;row < rows;row++) {
+      if(!readVarint(input, end, value)) {
+	return false;
+      }
+      if(codec == Xor) {
+	previous ^= value;
+      } else {
+	previousDelta += (value >> 1) ^ (0 - (value & 1));
+	previous += previousDelta;
+      }
+      values[row * stride] = fromBits(previous);
+    }
+    return true;
+  }
+
+  class TraceWriter::Private {
+  public:
+    class Block {
+    public:
+      Block(const int size) : values(size), rows(0) {}
+      vector<Scalar> values;
+      int rows;
+    };
+
+    ofstream output;
+    int columns;
+    int blockRows;
+    bool compressed;
+    string encoded, candidate;
+    Block* filling;
+    deque<Block*> full;
+    vector<Block*> spare;
+    mutex lock;
+    condition_variable ready, drained;
+    bool writing;
+    bool closing;
+    bool closed;
+    thread writer;
+
+    Private(const string& path, const vector<string>& names, const vector<string>& units,
+	    const string& settings, const int blockRows, const bool compressed) :
+      output(path.c_str(), ios::binary), columns(names.size()), blockRows(blockRows), compressed(compressed) {
+      output.write(traceMagic, sizeof(traceMagic));
+      uint32_t header[2] = {compressed ? compressedTraceVersion : traceVersion, (uint32_t)columns};
+      output.write((const char*)header, sizeof(header));
+      for(int i = 0;i < columns;i++) {
+	writeString(output, names[i]);
+	writeString(output, i < (int)units.size() ? units[i] : string());
+      }
+      writeString(output, settings);
+      start();
+    }
+
+    Private(const string& path, const int columns, const long offset, const int blockRows) :
+      columns(columns), blockRows(blockRows) {
+      uint32_t version = traceVersion;
+      {
+	ifstream input(path.c_str(), ios::binary);
+	input.seekg(sizeof(traceMagic));
+	readBinary(input, version);
+      }
+      compressed = version == compressedTraceVersion;
+      if(truncate(path.c_str(), offset) != 0) {
+	cerr << path << ": cannot truncate to " << offset << endl;
+      } else {
+	output.open(path.c_str(), ios::binary | ios::in | ios::out);
+	output.seekp(0, ios::end);
+      }
+      start();
+    }
+
+    void start() {
+      closing = false;
+      closed = false;
+      writing = false;
+      filling = new Block(columns * blockRows);
+      spare.push_back(new Block(columns * blockRows));
+      writer = thread(&Private::drain, this);
+    }
+
+    ~Private() {
+      close();
+      delete filling;
+      for(size_t i = 0;i < spare.size();i++) {
+	delete spare[i];
+      }
+    }
+
+    // Hands the filling block to the I/O thread and continues in a spare one.
+    // A new block is allocated rather than waiting when the disk falls behind.
+    void handOff() {
+      lock_guard<mutex> guard(lock);
+      full.push_back(filling);
+      if(spare.empty()) {
+	filling = new Block(columns * blockRows);
+      } else {
+	filling = spare.back();
+	spare.pop_back();
+      }
+      filling->rows = 0;
+      ready.notify_one();
+    }
+
+    void drain() {
+      while(true) {
+	Block* block;
+	{
+	  unique_lock<mutex> guard(lock);
+	  while(full.empty() && !closing) {
+	    ready.wait(guard);
+	  }
+	  if(full.empty()) {
+	    return;
+	  }
+	  block = full.front();
+	  full.pop_front();
+	  writing = true;
+	}
+	uint32_t rows = block->rows;
+	output.write((const char*)&rows, sizeof(rows));
+	if(compressed) {
+	  encoded.clear();
+	  for(int column = 0;column < columns;column++) {
+	    candidate.clear();
+	    encodeColumn(&block->values[column * blockRows], rows, Xor, candidate);
+	    size_t start = encoded.size();
+	    encodeColumn(&block->values[column * blockRows], rows, Delta, encoded);
+	    if(candidate.size() < encoded.size() - start) {
+	      encoded.replace(start, string::npos, candidate);
+	    }
+	  }
+	  uint32_t bytes = encoded.size();
+	  output.write((const char*)&bytes, sizeof(bytes));
+	  output.write(encoded.data(), bytes);
+	} else {
+	  for(int column = 0;column < columns;column++) {
+	    output.write((const char*)&block->values[column * blockRows], rows * sizeof(Scalar));
+	  }
+	}
+	lock_guard<mutex> guard(lock);
+	spare.push_back(block);
+	writing = false;
+	if(full.empty()) {
+	  drained.notify_all();
+	}
+      }
+    }
+
+    // Waits until every appended row is on disk and returns the file size.
+    long flush() {
+      if(filling->rows > 0) {
+	handOff();
+      }
+      unique_lock<mutex> guard(lock);
+      while(!full.empty() || writing) {
+	drained.wait(guard);
+      }
+      output.flush();
+      return output.tellp();
+    }
+
+    void close() {
+      if(closed) {
+	return;
+      }
+      closed = true;
+      if(filling->rows > 0) {
+	handOff();
+      }
+      {
+	lock_guard<mutex> guard(lock);
+	closing = true;
+	ready.notify_one();
+      }
+      writer.join();
+      output.close();
+    }
+  };
+
+  TraceWriter::TraceWriter(const string& path, const vector<string>& names, const vector<string>& units,
+			   const string& settings, const int blockRows, const bool compressed) :
+    priv(new Private(path, names, units, settings, blockRows, compressed)) {}
+
+  TraceWriter::TraceWriter(const string& path, const int columns, const long offset, const int blockRows) :
+    priv(new Private(path, columns, offset, blockRows)) {}
+
+  TraceWriter::~TraceWriter() {
+    delete priv;
+  }
+
+  bool TraceWriter::isOpen() const {
+    return priv->output.is_open();
+  }
+
+  int TraceWriter::getColumns() const {
+    return priv->columns;
+  }
+
+  void TraceWriter::append(const Scalar* row) {
+    Private::Block* block = priv->filling;
+    for(int column = 0;column < priv->columns;column++) {
+      block->values[column * priv->blockRows + block->rows] = row[column];
+    }
+    if(++block->rows == priv->blockRows) {
+      priv->handOff();
+    }
+  }
+
+  long TraceWriter::flush() {
+    return priv->flush();
+  }
+
+  void TraceWriter::close() {
+    priv->close();
+  }
+
+  TraceDecimator::TraceDecimator(const int columns, const Scalar tolerance) :
+    columns(columns), tolerance(tolerance), anchor(columns), pending(columns), lower(columns), upper(columns),
+    hasAnchor(false), hasPending(false) {}
+
+  void TraceDecimator::add(const Scalar* row, vector<Scalar>& output) {
+    if(!hasAnchor) {
+      output.insert(output.end(), row, row + columns);
+      anchor.assign(row, row + columns);
+      hasAnchor = true;
+      return;
+    }
+    if(!hasPending) {
+      pending.assign(row, row + columns);
+      fill(lower.begin(), lower.end(), -HUGE_VAL);
+      fill(upper.begin(), upper.end(), HUGE_VAL);
+      hasPending = true;
+      return;
+    }
+    // The slopes from anchor that pass pending and every row before it, against the slope to row.
+    const Scalar pendingSpan = pending[0] - anchor[0], span = row[0] - anchor[0];
+    bool reachable = pendingSpan > 0 && span > 0;
+    for(int column = 1;column < columns && reachable;column++) {
+      Scalar low = max(lower[column], (pending[column] - tolerance - anchor[column]) / pendingSpan);
+      Scalar high = min(upper[column], (pending[column] + tolerance - anchor[column]) / pendingSpan);
+      Scalar slope = (row[column] - anchor[column]) / span;
+      reachable = low <= slope && slope <= high;
+    }
+    if(reachable) {
+      for(int column = 1;column < columns;column++) {
+	lower[column] = max(lower[column], (pending[column] - tolerance - anchor[column]) / pendingSpan);
+	upper[column] = min(upper[column], (pending[column] + tolerance - anchor[column]) / pendingSpan);
+      }
+    } else {
+      output.insert(output.end(), pending.begin(), pending.end());
+      anchor.swap(pending);
+      fill(lower.begin(), lower.end(), -HUGE_VAL);
+      fill(upper.begin(), upper.end(), HUGE_VAL);
+    }
+    pending.assign(row, row + columns);
+  }
+
+  void TraceDecimator::flush(vector<Scalar>& output) {
+    if(hasPending) {
+      output.insert(output.end(), pending.begin(), pending.end());
+    }
+    hasAnchor = false;
+    hasPending = false;
+  }
+
+  class TraceReader::Private {
+  public:
+    ifstream input;
+    bool open;
+    bool compressed;
+    string encoded;
+    vector<string> names;
+    vector<string> units;
+    string settings;
+    vector<Scalar> block;
+
+    Private(const string& path) : input(path.c_str(), ios::binary), open(false), compressed(false) {
+      char magic[sizeof(traceMagic)];
+      uint32_t header[2];
+      if(!input.read(magic, sizeof(magic)) || memcmp(magic, traceMagic, sizeof(magic)) != 0
+	 || !input.read((char*)header, sizeof(header))
+	 || (header[0] != traceVersion && header[0] != compressedTraceVersion)) {
+	return;
+      }
+      compressed = header[0] == compressedTraceVersion;
+      names.resize(header[1]);
+      units.resize(header[1]);
+      for(uint32_t i = 0;i < header[1];i++) {
+	if(!readString(input, names[i]) || !readString(input, units[i])) {
+	  return;
+	}
+      }
+      open = readString(input, settings);
+    }
+  };
+
+  TraceReader::TraceReader(const string& path) : priv(new Private(path)) {}
+
+  TraceReader::~TraceReader() {
+    delete priv;
+  }
+
+  bool TraceReader::isOpen() const {
+    return priv->open;
+  }
+
+  int TraceReader::getColumns() const {
+    return priv->names.size();
+  }
+
+  const vector<string>& TraceReader::getNames() const {
+    return priv->names;
+  }
+
+  const vector<string>& TraceReader::getUnits() const {
+    return priv->units;
+  }
+
+  const string& TraceReader::getSettings() const {
+    return priv->settings;
+  }
+
+  bool TraceReader::readBlock(vector<Scalar>& rows) {
+    uint32_t count;
+    if(!priv->open || !priv->input.read((char*)&count, sizeof(count))) {
+      return false;
+    }
+    const int columns = getColumns();
+    if(count == 0) {
+      rows.clear();
+      return true;
+    }
+    if(priv->compressed) {
+      uint32_t bytes;
+      if(!priv->input.read((char*)&bytes, sizeof(bytes))) {
+	return false;
+      }
+      priv->encoded.resize(bytes);
+      if(!priv->input.read(&priv->encoded[0], bytes)) {
+	return false;
+      }
+      rows.resize(count * columns);
+      const unsigned char* input = (const unsigned char*)priv->encoded.data();
+      const unsigned char* end = input + bytes;
+      for(int column = 0;column < columns;column++) {
+	if(!decodeColumn(input, end, count, &rows[column], columns)) {
+	  return false;
+	}
+      }
+      return true;
+    }
+    priv->block.resize(count * columns);
+    if(!priv->input.read((char*)&priv->block[0], count * columns * sizeof(Scalar))) {
+      return false;
+    }
+    rows.resize(count * columns);
+    for(int column = 0;column < columns;column++) {
+      for(uint32_t row = 0;row < count;row++) {
+	rows[row * columns + column] = priv->block[column * count + row];
+      }
+    }
+    return true;
+  }
+}
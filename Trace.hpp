@@ -0,0 +1,95 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include "HodgkinHuxley.hpp"
+#include <string>
+#include <vector>
+
+namespace Jarl {
+  /*
+   * Binary columnar trace files. Layout, in host byte order:
+   *
+   *   "HHTRACE\0"                     magic
+   *   uint32 version, uint32 columns
+   *   per column: string name, string unit
+   *   string settings                 free text, usually Settings::toString()
+   *   blocks until end of file:
+   *     uint32 rows
+   *     rows doubles of column 0, rows doubles of column 1, ...
+   *
+   * where a string is a uint32 length followed by that many bytes. A block
+   * cut short by a crash is ignored by the reader.
+   *
+   * Compressed traces are version 2 and store each block as
+   *     uint32 rows, uint32 bytes
+   *     per column: uint8 codec, rows varints
+   * where every value is encoded losslessly against the ones before it in
+   * the block: XOR keeps the bits that changed, and delta keeps the change
+   * in the change of the bit pattern, small for smoothly varying columns
+   * such as time. Varints hold 7 bits per byte, low first, and the deltas
+   * are zigzagged so small negatives stay short. The writer picks the
+   * smaller codec per column and block.
+   */
+  class TraceWriter {
+  public:
+    TraceWriter(const std::string& path, const std::vector<std::string>& names,
+		const std::vector<std::string>& units, const std::string& settings,
+		const int blockRows = 8192, const bool compressed = false);
+    // Continues an existing trace of either version, dropping everything after offset, as returned by flush().
+    TraceWriter(const std::string& path, const int columns, const long offset, const int blockRows = 8192);
+    ~TraceWriter();
+    // False when the trace to continue could not be cut back and reopened.
+    bool isOpen() const;
+    int getColumns() const;
+    void append(const Scalar* row);
+    long flush();
+    void close();
+  private:
+    TraceWriter(const TraceWriter&);
+    TraceWriter& operator=(const TraceWriter&);
+    class Private;
+    Private* const priv;
+  };
+
+  /*
+   * Drops the trace rows that the straight line between the rows kept
+   * around them reproduces to within tolerance, in every column but the
+   * first, which is the time. Fed every step, it keeps rows densely through
+   * a spike and sparsely at rest. A row is kept once no single line from
+   * the last kept row passes within tolerance of every row since.
+   */
+  class TraceDecimator {
+  public:
+    TraceDecimator(const int columns, const Scalar tolerance);
+    // Appends the rows that are kept to output.
+    void add(const Scalar* row, std::vector<Scalar>& output);
+    // Keeps the last row fed and starts over as though nothing had been.
+    void flush(std::vector<Scalar>& output);
+  private:
+    int columns;
+    Scalar tolerance;
+    std::vector<Scalar> anchor, pending, lower, upper;
+    bool hasAnchor;
+    bool hasPending;
+  };
+
+  class TraceReader {
+  public:
+    TraceReader(const std::string& path);
+    ~TraceReader();
+    bool isOpen() const;
+    int getColumns() const;
+    const std::vector<std::string>& getNames() const;
+    const std::vector<std::string>& getUnits() const;
+    const std::string& getSettings() const;
+    // Reads the next block as rows * columns values, row major. False at end of file.
+    bool readBlock(std::vector<Scalar>& rows);
+  private:
+    TraceReader(const TraceReader&);
+    TraceReader& operator=(const TraceReader&);
+    class Private;
+    Private* const priv;
+  };
+}
+
+#endif
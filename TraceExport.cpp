@@ -0,0 +1,44 @@
+#include "Trace.hpp"
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+using namespace std;
+using namespace Jarl;
+
+// TraceExport trace [tsv] converts a binary trace to the tab separated layout rateExperiment used to write.
+int main(int argc, char* argv[]) {
+  if(argc < 2) {
+    cerr << "usage: " << argv[0] << " trace [tsv]" << endl;
+    return 1;
+  }
+  TraceReader reader(argv[1]);
+  if(!reader.isOpen()) {
+    cerr << argv[1] << ": not a trace file" << endl;
+    return 1;
+  }
+
+  ofstream file;
+  if(argc > 2) {
+    file.open(argv[2]);
+  }
+  ostream& output = argc > 2 ? file : cout;
+  output.precision(10);
+
+  const int columns = reader.getColumns();
+  for(int column = 0;column < columns;column++) {
+    output << reader.getNames()[column];
+    if(!reader.getUnits()[column].empty()) {
+      output << " (" << reader.getUnits()[column] << ")";
+    }
+    output << (column + 1 < columns ? "\t" : "\n");
+  }
+
+  vector<Scalar> rows;
+  while(reader.readBlock(rows)) {
+    for(size_t i = 0;i < rows.size();i++) {
+      output << rows[i] << ((i + 1) % columns == 0 ? "\n" : "\t");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,235 @@
+#include "HodgkinHuxley.hpp"
+#include "Experiment.hpp"
+#include "Protocol.hpp"
+#include "RateRun.hpp"
+#include "RateTable.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <math.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stdlib.h>
+
+using namespace std;
+using namespace Jarl;
+
+/*
+ * Validation [table] [duration] [reference step] measures how far the
+ * cheaper ways of running the model drift from a reference run of the
+ * standard protocol: classic Runge-Kutta in long double on a fixed step of
+ * reference step ms, 1e-4 by default. Every other setting runs the same
+ * protocol the way the experiments do and is compared with it on the spike
+ * times, the rate and, every ms, the potential and reversal potentials,
+ * next to its wall time and right hand side evaluations. The table is
+ * written to stdout and, if given, to table. A setting is on the Pareto
+ * front when no other one is both faster and at least as close in spike
+ * times; a wrong spike count counts as infinitely far. The reference's own
+ * error is about a fifteenth of that of the long double run on twice its
+ * step, which is in the table for that. duration is in ms, 1000 by default.
+ */
+
+static const Scalar sampleInterval = 1;
+static const int repeats = 3;
+
+static double seconds() {
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// One way of running the model. Precision and fixed only apply to RungeKutta, tolerance only to DormandPrince and Multirate.
+class Setting {
+public:
+  Setting(const HodgkinHuxley::Integrator integrator, const Scalar step, const Scalar tolerance = 0,
+	  const HodgkinHuxley::Precision precision = HodgkinHuxley::Double, const bool tabulated = false,
+	  const bool fixed = false) :
+    integrator(integrator), step(step), tolerance(tolerance), precision(precision), tabulated(tabulated), fixed(fixed) {}
+  HodgkinHuxley::Integrator integrator;
+  // The resolution for RungeKutta, the maximum step for the others.
+  Scalar step;
+  Scalar tolerance;
+  HodgkinHuxley::Precision precision;
+  bool tabulated;
+  // Held at one resolution, the legacy stepper never lengthens its steps.
+  bool fixed;
+};
+
+// What a run of a Setting produced, sampled every sampleInterval.
+class Outcome {
+public:
+  vector<Scalar> potentials;
+  vector<Scalar> potassiumReversalPotentials;
+  vector<Scalar> sodiumReversalPotentials;
+  vector<Scalar> spikes;
+  Scalar rate;
+  unsigned long rhsEvaluations;
+  double seconds;
+};
+
+static Outcome run(const Setting& setting, const Protocol& protocol, const RateTable& table) {
+  ExperimentSettings settings;
+  settings.neuron = referenceSettings();
+  settings.integrator = setting.integrator;
+  settings.resolution = setting.step;
+  settings.maximumStep = setting.step;
+  settings.rateTable = setting.tabulated ? &table : NULL;
+  settings.traceFormat = ExperimentSettings::NoTrace;
+  settings.verbose = false;
+
+  Outcome outcome;
+  RateRun rateRun(settings, protocol, "validation");
+  HodgkinHuxley& neuron = rateRun.neuron;
+  neuron.setIntegrator(settings.integrator);
+  neuron.setRateTable(settings.rateTable);
+  neuron.setPrecision(setting.precision);
+  if(setting.tolerance > 0) {
+    neuron.setTolerances(setting.tolerance, setting.tolerance);
+  }
+  const Scalar duration = protocol.getDuration();
+  const double start = seconds();
+  for(int64_t sample = 0;sample * sampleInterval <= duration;sample++) {
+    const Scalar time = sample * sampleInterval;
+    while(!rateRun.isFinished() && rateRun.state.currentTime < time) {
+      if(setting.fixed) {
+	rateRun.state.steps = 1;
+      }
+      rateRun.step(time);
+    }
+    outcome.potentials.push_back(neuron.getPotential());
+    outcome.potassiumReversalPotentials.push_back(neuron.getPotassiumReversalPotential());
+    outcome.sodiumReversalPotentials.push_back(neuron.getSodiumReversalPotential());
+  }
+  outcome.seconds = seconds() - start;
+  outcome.spikes = rateRun.analyzer.getSpikeTimes();
+  outcome.rate = rateRun.analyzer.getRate(duration);
+  outcome.rhsEvaluations = neuron.getRhsEvaluations();
+  return outcome;
+}
+
+static Scalar maximumError(const vector<Scalar>& values, const vector<Scalar>& reference) {
+  Scalar error = 0;
+  for(size_t i = 0;i < values.size();i++) {
+    Scalar difference = fabs(values[i] - reference[i]);
+    // NaN compares false, so a run that blew up has to be caught on its own.
+    error = difference == difference ? max(error, difference) : numeric_limits<Scalar>::infinity();
+  }
+  return error;
+}
+
+static Scalar rmsError(const vector<Scalar>& values, const vector<Scalar>& reference) {
+  Scalar squares = 0;
+  for(size_t i = 0;i < values.size();i++) {
+    squares += (values[i] - reference[i]) * (values[i] - reference[i]);
+  }
+  return sqrt(squares / values.size());
+}
+
+// Largest difference between corresponding spikes, infinite if there are not as many.
+static Scalar spikeTimeError(const vector<Scalar>& spikes, const vector<Scalar>& reference) {
+  if(spikes.size() != reference.size()) {
+    return numeric_limits<Scalar>::infinity();
+  }
+  return maximumError(spikes, reference);
+}
+
+static string integratorName(const HodgkinHuxley::Integrator integrator) {
+  static const char* names[] = {"runge_kutta", "dormand_prince", "rush_larsen", "multirate"};
+  return names[integrator];
+}
+
+static string precisionName(const HodgkinHuxley::Precision precision) {
+  static const char* names[] = {"float", "double", "long double"};
+  return names[precision];
+}
+
+int main(int argc, char* argv[]) {
+  ofstream table;
+  if(argc > 1) {
+    table.open(argv[1]);
+    if(!table) {
+      cerr << argv[1] << ": cannot open" << endl;
+      return 1;
+    }
+  }
+  Scalar duration = argc > 2 ? atof(argv[2]) : 1000;
+  Scalar referenceStep = argc > 3 ? atof(argv[3]) : 1e-4;
+
+  Protocol protocol = Protocol::standard(1, 2, 0);
+  protocol.setDuration(duration);
+  RateTable rates(1e-10);
+
+  vector<Setting> settings;
+  settings.push_back(Setting(HodgkinHuxley::RungeKutta, 2 * referenceStep, 0, HodgkinHuxley::Extended, false, true));
+  const Scalar resolutions[] = {1e-2, 5e-3, 2e-3, 1e-3, 5e-4};
+  for(const Scalar resolution : resolutions) {
+    settings.push_back(Setting(HodgkinHuxley::RungeKutta, resolution));
+  }
+  settings.push_back(Setting(HodgkinHuxley::RungeKutta, 1e-3, 0, HodgkinHuxley::Single));
+  settings.push_back(Setting(HodgkinHuxley::RungeKutta, 1e-3, 0, HodgkinHuxley::Extended));
+  settings.push_back(Setting(HodgkinHuxley::RungeKutta, 1e-3, 0, HodgkinHuxley::Double, true));
+  for(Scalar tolerance = 1e-3;tolerance > 1e-9;tolerance /= 10) {
+    settings.push_back(Setting(HodgkinHuxley::DormandPrince, .1, tolerance));
+  }
+  settings.push_back(Setting(HodgkinHuxley::DormandPrince, .1, 1e-6, HodgkinHuxley::Double, true));
+  for(Scalar tolerance = 1e-5;tolerance > 1e-9;tolerance /= 10) {
+    settings.push_back(Setting(HodgkinHuxley::Multirate, .1, tolerance));
+  }
+  const Scalar steps[] = {.1, .05, .02, .01, .005};
+  for(const Scalar step : steps) {
+    settings.push_back(Setting(HodgkinHuxley::RushLarsen, step));
+  }
+
+  cerr << "reference: runge_kutta in long double every " << referenceStep << " ms for " << duration << " ms" << endl;
+  const Outcome reference = run(Setting(HodgkinHuxley::RungeKutta, referenceStep, 0, HodgkinHuxley::Extended, false, true),
+				protocol, rates);
+
+  vector<Outcome> outcomes;
+  vector<Scalar> spikeErrors;
+  for(const Setting& setting : settings) {
+    Outcome outcome = run(setting, protocol, rates);
+    // The check of the reference is only there for its errors, and is as slow.
+    for(int repeat = 1;repeat < repeats && !setting.fixed;repeat++) {
+      outcome.seconds = min(outcome.seconds, run(setting, protocol, rates).seconds);
+    }
+    outcomes.push_back(outcome);
+    spikeErrors.push_back(spikeTimeError(outcome.spikes, reference.spikes));
+  }
+
+  stringstream lines;
+  lines.precision(4);
+  lines << "integrator\tstep (ms)\ttolerance\tprecision\trates\tseconds\trhs evaluations\tspikes\t"
+	<< "spike time error (ms)\trate error (Hz)\tpotential rms error (mV)\tpotential max error (mV)\t"
+	<< "potassium reversal error (mV)\tsodium reversal error (mV)\tpareto\n";
+  lines << "runge_kutta\t" << referenceStep << "\t-\tlong double\texact\t" << reference.seconds << "\t"
+	<< reference.rhsEvaluations << "\t" << reference.spikes.size() << "\t0\t0\t0\t0\t0\t0\treference\n";
+  for(size_t i = 0;i < settings.size();i++) {
+    const Setting& setting = settings[i];
+    const Outcome& outcome = outcomes[i];
+    bool pareto = spikeErrors[i] < numeric_limits<Scalar>::infinity();
+    for(size_t j = 0;j < settings.size() && pareto;j++) {
+      pareto = !(outcomes[j].seconds < outcome.seconds && spikeErrors[j] <= spikeErrors[i]);
+    }
+    lines << integratorName(setting.integrator) << "\t" << setting.step << "\t";
+    if(setting.tolerance > 0) {
+      lines << setting.tolerance;
+    } else {
+      lines << "-";
+    }
+    lines << "\t" << precisionName(setting.precision) << "\t" << (setting.tabulated ? "table" : "exact") << "\t"
+	  << outcome.seconds << "\t" << outcome.rhsEvaluations << "\t" << outcome.spikes.size() << "\t"
+	  << spikeErrors[i] << "\t" << fabs(outcome.rate - reference.rate) << "\t"
+	  << rmsError(outcome.potentials, reference.potentials) << "\t"
+	  << maximumError(outcome.potentials, reference.potentials) << "\t"
+	  << maximumError(outcome.potassiumReversalPotentials, reference.potassiumReversalPotentials) << "\t"
+	  << maximumError(outcome.sodiumReversalPotentials, reference.sodiumReversalPotentials) << "\t"
+	  << (pareto ? "yes" : "no") << "\n";
+  }
+  cout << lines.str() << flush;
+  if(table.is_open()) {
+    table << lines.str();
+  }
+  return 0;
+}
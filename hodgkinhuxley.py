@@ -0,0 +1,170 @@
+"""
+ctypes binding of libhodgkinhuxley.so, see HodgkinHuxleyApi.h. Traces are
+written by the library straight into numpy arrays, one row per sample with
+the time followed by the state in the order of VARIABLES:
+
+    neuron = hodgkinhuxley.Neuron()
+    neuron.set_parameter("blebbing", 1)
+    trace = neuron.simulate(20000, .1)
+    potential = trace[:, 1 + hodgkinhuxley.VARIABLES.index("potential")]
+
+Build the library with make libhodgkinhuxley.so; it is looked for next to
+this file unless HH_LIBRARY names it.
+"""
+
+import ctypes
+import math
+import os
+
+import numpy
+
+VARIABLES = ["potential", "n", "m", "h", "blebbed m", "blebbed h",
+             "inner potassium concentration", "outer potassium concentration",
+             "inner sodium concentration", "outer sodium concentration"]
+INTEGRATORS = ["runge kutta", "dormand prince", "rush larsen", "multirate"]
+PARAMETERS = ["blebbing", "left shift", "stimulation"]
+
+
+class Settings(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_double) for name in [
+        "potential", "capacitance", "leakConductance", "leakReversalPotential",
+        "potassiumConductance", "potassiumReversalPotential", "sodiumConductance",
+        "sodiumReversalPotential", "maxPumpCurrent", "innerPotassiumConcentration",
+        "outerPotassiumConcentration", "innerSodiumConcentration", "outerSodiumConcentration",
+        "surfaceArea", "innerVolume", "outerVolume", "temperature", "threshold",
+        "potassiumLeakConductance", "sodiumLeakConductance", "blebbing", "leftShift",
+        "stimulation"]]
+
+
+_library = ctypes.CDLL(os.environ.get("HH_LIBRARY", os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                                                  "libhodgkinhuxley.so")))
+_neuron = ctypes.c_void_p
+_protocol = ctypes.c_void_p
+_doubles = ctypes.POINTER(ctypes.c_double)
+for name, result, arguments in [
+        ("hh_version", ctypes.c_int, []),
+        ("hh_trace_columns", ctypes.c_int, []),
+        ("hh_reference_settings", None, [ctypes.POINTER(Settings)]),
+        ("hh_create", _neuron, [ctypes.POINTER(Settings)]),
+        ("hh_copy", _neuron, [_neuron]),
+        ("hh_destroy", None, [_neuron]),
+        ("hh_set_integrator", ctypes.c_int, [_neuron, ctypes.c_int]),
+        ("hh_set_parameter", ctypes.c_int, [_neuron, ctypes.c_int, ctypes.c_double]),
+        ("hh_get_time", ctypes.c_double, [_neuron]),
+        ("hh_get_state", None, [_neuron, _doubles]),
+        ("hh_get_spikes", ctypes.c_long, [_neuron, _doubles, ctypes.c_long]),
+        ("hh_simulate", ctypes.c_long, [_neuron, ctypes.c_double, ctypes.c_double, _doubles, ctypes.c_long]),
+        ("hh_protocol_create", _protocol, [ctypes.c_double]),
+        ("hh_protocol_load", _protocol, [ctypes.c_char_p]),
+        ("hh_protocol_destroy", None, [_protocol]),
+        ("hh_protocol_add", ctypes.c_int, [_protocol, ctypes.c_int, ctypes.c_double, ctypes.c_double,
+                                           ctypes.c_double, ctypes.c_double]),
+        ("hh_protocol_duration", ctypes.c_double, [_protocol]),
+        ("hh_run_protocol", ctypes.c_long, [_neuron, _protocol, ctypes.c_double, _doubles, ctypes.c_long])]:
+    function = getattr(_library, name)
+    function.restype = result
+    function.argtypes = arguments
+
+if _library.hh_version() != 1:
+    raise ImportError("libhodgkinhuxley.so is version %d, this binding is version 1" % _library.hh_version())
+
+COLUMNS = _library.hh_trace_columns()
+
+
+def reference_settings():
+    """The neuron every experiment in Main starts from."""
+    settings = Settings()
+    _library.hh_reference_settings(ctypes.byref(settings))
+    return settings
+
+
+def _trace_buffer(out, start, end, interval):
+    """out, or a new array just long enough for the samples between start and end."""
+    if out is None:
+        rows = 0 if interval <= 0 else int(math.floor(end / interval) - math.floor(start / interval)) + 1
+        out = numpy.empty((rows, COLUMNS))
+    if out.dtype != numpy.float64 or out.ndim != 2 or out.shape[1] != COLUMNS or not out.flags.c_contiguous:
+        raise ValueError("trace buffers are C contiguous float64 arrays of %d columns" % COLUMNS)
+    return out
+
+
+class Protocol(object):
+    """A stimulus protocol, from a file as Main protocol reads them or built segment by segment."""
+
+    def __init__(self, duration=0, path=None):
+        if path is None:
+            self._handle = _library.hh_protocol_create(duration)
+        else:
+            self._handle = _library.hh_protocol_load(path.encode())
+            if not self._handle:
+                raise IOError("%s: not a protocol" % path)
+
+    def __del__(self):
+        if getattr(self, "_handle", None):
+            _library.hh_protocol_destroy(self._handle)
+
+    @property
+    def duration(self):
+        return _library.hh_protocol_duration(self._handle)
+
+    def add(self, parameter, start, end, value, to=None):
+        """Holds parameter at value on [start, end), or ramps it from value to to."""
+        _library.hh_protocol_add(self._handle, PARAMETERS.index(parameter), start, end, value,
+                                 value if to is None else to)
+
+
+class Neuron(object):
+    def __init__(self, settings=None, _handle=None):
+        if _handle is None:
+            settings = reference_settings() if settings is None else settings
+            _handle = _library.hh_create(ctypes.byref(settings))
+        self._handle = _handle
+
+    def __del__(self):
+        if getattr(self, "_handle", None):
+            _library.hh_destroy(self._handle)
+
+    def copy(self):
+        """A neuron that continues independently from this one's history."""
+        return Neuron(_handle=_library.hh_copy(self._handle))
+
+    def set_integrator(self, integrator):
+        _library.hh_set_integrator(self._handle, INTEGRATORS.index(integrator))
+
+    def set_parameter(self, parameter, value):
+        _library.hh_set_parameter(self._handle, PARAMETERS.index(parameter), value)
+
+    @property
+    def time(self):
+        return _library.hh_get_time(self._handle)
+
+    @property
+    def state(self):
+        state = numpy.empty(len(VARIABLES))
+        _library.hh_get_state(self._handle, state.ctypes.data_as(_doubles))
+        return state
+
+    @property
+    def spikes(self):
+        count = _library.hh_get_spikes(self._handle, None, 0)
+        spikes = numpy.empty(count)
+        _library.hh_get_spikes(self._handle, spikes.ctypes.data_as(_doubles), count)
+        return spikes
+
+    def simulate(self, duration, interval=0, out=None):
+        """
+        Advances by duration, sampling every interval ms. Returns the rows
+        written, a view of out when it is given. A full out stops the run
+        early; call again with the rest of the duration to continue.
+        """
+        start = self.time
+        out = _trace_buffer(out, start, start + duration, interval)
+        rows = _library.hh_simulate(self._handle, duration, interval, out.ctypes.data_as(_doubles), out.shape[0])
+        return out[:rows]
+
+    def run_protocol(self, protocol, interval=0, out=None):
+        """Runs protocol from the current time to its end, sampling like simulate."""
+        out = _trace_buffer(out, self.time, protocol.duration, interval)
+        rows = _library.hh_run_protocol(self._handle, protocol._handle, interval, out.ctypes.data_as(_doubles),
+                                        out.shape[0])
+        return out[:rows]